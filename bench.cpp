@@ -0,0 +1,544 @@
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#define _HAS_EXCEPTIONS 0
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <span>
+#include <unordered_map>
+#include <iostream>
+#include <filesystem>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "platform.h"
+#include "text.h"
+#include "table.h"
+#include "state.h"
+#include "buffer.h"
+#include "file.h"
+#include "workers.h"
+#include "font.h"
+#include "frame.h"
+#include "switcher.h"
+
+// Headless measurements: bench <font.ttf> <file> [case]. Runs every case unless one is named.
+
+static inline std::atomic<size_t> allocations = 0; // Heap allocations so far, counted by the operator new below.
+
+void* operator new(size_t size) {
+	allocations++;
+	if (void* mem = malloc(size ? size : 1))
+		return mem;
+	abort();
+}
+void operator delete(void* mem) noexcept { free(mem); }
+void operator delete(void* mem, size_t) noexcept { free(mem); }
+
+static inline unsigned failures = 0; // Failed checks, for the exit code.
+
+static inline volatile size_t sink = 0; // Keeps results of timed loops alive.
+
+template <typename F> int64_t fastest_us(unsigned runs, F func) { // Best of runs, past cold caches and preemption.
+	int64_t best = INT64_MAX;
+	for (unsigned i = 0; i < runs; ++i) {
+		Timer timer;
+		func();
+		best = std::min(best, timer.get_elapsed_time_us());
+	}
+	return std::max(best, (int64_t)1);
+}
+
+template <typename F> void for_each_path(F func) { // AVX2 when the CPU has it, then SSE2.
+	const bool avx2 = use_avx2;
+	if (avx2)
+		func("avx2");
+	use_avx2 = false;
+	func("sse2");
+	use_avx2 = avx2;
+}
+
+struct Scene { // The file in a 4K frame at 16px, as the window would show it.
+	Switcher switcher;
+	Book book;
+	Frame frame;
+	Renderer renderer;
+	double font_size = 16.0;
+	unsigned col_count = 0;
+	unsigned row_count = 0;
+
+	Scene(const std::string_view font, const std::string_view filename)
+		: book(font) {
+		switcher.open(filename);
+		book.set_font_size(font_size);
+		frame.resize(3840, 2160);
+		if (book.get_character_width() > 0 && book.get_line_height() > 0) { // Cells are sized from the glyph of code point 0.
+			col_count = frame.get_width() / book.get_character_width();
+			row_count = frame.get_height() / book.get_line_height();
+		}
+		else {
+			std::cerr << font << " has no advance for code point 0\n";
+		}
+	}
+
+	bool is_valid() const { return col_count > 0; }
+
+	Characters cull(int& scroll) { return switcher.cull(col_count, row_count, "bench", scroll); }
+
+	int64_t full_frame_us(unsigned runs) { // Fastest repaint of every row.
+		int scroll = 0;
+		const auto characters = cull(scroll);
+		return fastest_us(runs, [&] {
+			renderer.reset();
+			renderer.render(frame, book, characters, col_count, row_count, 0);
+		});
+	}
+};
+
+void check_rows() { // The SIMD row kernels against Color::blend and plain stores, on every path.
+	std::array<uint8_t, 61> coverage; // Odd, so every path has a tail.
+	for (size_t i = 0; i < coverage.size(); ++i)
+		coverage[i] = (uint8_t)(i * 67);
+	for_each_path([&](const char* path) {
+		for (const auto color : { colors().text, colors().highlight, colors().clear }) {
+			std::vector<Color> expected(coverage.size(), colors().cursor_line), blended = expected, filled = expected;
+			for (size_t i = 0; i < coverage.size(); ++i)
+				expected[i].blend(Color(color).set_alpha(coverage[i]));
+			blend_row(blended.data(), coverage.data(), (int)coverage.size(), color);
+			fill_row(filled.data(), (int)filled.size(), color);
+			if (blended != expected || filled != std::vector<Color>(filled.size(), color)) {
+				std::cerr << "frames: " << path << " row kernels differ from the scalar code\n";
+				failures++;
+			}
+		}
+	});
+}
+
+void bench_frames(const std::string_view font, const std::string_view filename) { // Scripted frames without a window; last frame to bench.ppm.
+	check_rows();
+	Scene scene(font, filename);
+	if (!scene.is_valid())
+		return;
+
+	struct Phase { const char* name; int64_t total = 0; int64_t max = 0; };
+	std::array<Phase, 3> phases = { Phase{ "process" }, Phase{ "cull" }, Phase{ "render" } };
+	const auto measure = [&](Phase& phase, auto func) {
+		Timer timer;
+		func();
+		const auto us = timer.get_elapsed_time_us();
+		phase.total += us;
+		phase.max = std::max(phase.max, us);
+	};
+
+	const unsigned frame_count = 200;
+	for (unsigned i = 0; i < frame_count; ++i) {
+		const bool space_down = i >= frame_count / 2; // Cursor moves, then whole pages.
+		bool quit = false, maximize = false, fields = false;
+		Characters characters;
+		int scroll = 0;
+		measure(phases[0], [&] { scene.switcher.process(space_down, quit, maximize, fields, scene.font_size, 'j'); });
+		measure(phases[1], [&] { characters = scene.cull(scroll); });
+		measure(phases[2], [&] { scene.renderer.render(scene.frame, scene.book, characters, scene.col_count, scene.row_count, scroll); });
+		if (i % 10 == 9) { // Damage tracking, scrolling and SIMD must draw what a full render does.
+			Frame full;
+			full.resize(scene.frame.get_width(), scene.frame.get_height());
+			Renderer().render(full, scene.book, characters, scene.col_count, scene.row_count, 0);
+			if (const auto different = scene.frame.count_different(full); different > 0) {
+				std::cerr << "frames: frame " << i << " differs from a full render in " << different << " pixels\n";
+				failures++;
+			}
+		}
+	}
+
+	std::cout << "frames: " << filename << " " << scene.frame.get_width() << "x" << scene.frame.get_height() << " " << frame_count << " frames\n";
+	for (auto& phase : phases) {
+		std::cout << "  " << phase.name << ": " << phase.total / frame_count << "us avg, " << phase.max << "us max\n";
+	}
+	std::cout << "  present: " << scene.frame.get_presented() / frame_count << " pixels avg\n";
+	scene.frame.dump("bench.ppm");
+}
+
+size_t rasterize_glyphs(const Font& font, Outlines& outlines, double size, std::vector<uint8_t>& image) { // Latin and Cyrillic from their outlines, returns the glyph count.
+	size_t count = 0;
+	for (uint32_t c = 0x20; c < 0x500; c = c == 0x7E ? 0x400 : c + 1) {
+		uint_fast32_t gid = 0;
+		if (font.glyph_id(c, &gid) < 0)
+			continue;
+		const auto mtx = font.get_metrics(gid, size);
+		const auto& entry = outlines.decode(font, gid);
+		int bbox[4];
+		if (!mtx.is_valid() || !entry.offset || font.glyph_bbox(entry.offset, size, bbox) < 0)
+			continue;
+		const auto transform = font.glyph_transform(bbox, size);
+		image.resize(std::max(image.size(), (size_t)mtx.minWidth * mtx.minHeight));
+		outlines.make_outline(entry, scratch()).render_outline(transform.data(), mtx.minWidth, mtx.minHeight, image.data());
+		count++;
+	}
+	return count;
+}
+
+void bench_allocations(const std::string_view font, const std::string_view) { // Heap allocations per glyph once the scratch buffers have grown.
+	Font source(font);
+	Outlines outlines;
+	std::vector<uint8_t> image;
+	const auto rasterize = [&](double size) { return rasterize_glyphs(source, outlines, size, image); };
+
+	const std::array<double, 4> sizes = { 8.0, 16.0, 32.0, 80.0 };
+	for (auto size : sizes) // Decode the outlines and grow the buffers.
+		rasterize(size);
+	std::cout << "allocations:\n";
+	for (auto size : sizes) {
+		const size_t before = allocations;
+		const auto count = rasterize(size);
+		std::cout << "  rasterize " << (int)size << "px: " << allocations - before << " for " << count << " glyphs\n";
+	}
+
+	Book book(font);
+	for (auto size : sizes) { // Through the atlas, so slots and atlas growth count too.
+		book.set_font_size(size);
+		const size_t before = allocations;
+		for (uint32_t c = 0x400; c < 0x500; ++c)
+			book.find_glyph(c);
+		std::cout << "  atlas " << (int)size << "px: " << allocations - before << " for 256 new glyphs\n";
+	}
+}
+
+void bench_newlines(const std::string_view, const std::string_view filename) { // Newline kernels over the file repeated to 256MB.
+	const auto store = load(filename);
+	if (!store) {
+		std::cerr << "newlines: can't read " << filename << "\n";
+		return;
+	}
+	const auto file = store->view();
+	std::string text;
+	text.reserve(256 * MB);
+	while (text.size() + file.size() <= 256 * MB)
+		text.append(file);
+	const double bytes = (double)text.size();
+	const auto rate = [&](int64_t us) { return bytes / (us * 1000.0); };
+
+	std::cout << "newlines: " << text.size() / MB << "MB\n";
+	size_t count = 0;
+	std::cout << "  std::count: " << rate(fastest_us(5, [&] { count = std::count(text.begin(), text.end(), '\n'); })) << " GB/s\n";
+	for_each_path([&](const char* path) {
+		size_t scanned = 0, sought = 0;
+		const auto scan = rate(fastest_us(5, [&] { scanned = scan_newlines(text); }));
+		const auto seek = rate(fastest_us(5, [&] { sought = seek_newline(text, count - 1); })); // The last one, so every block is read.
+		const auto append = rate(fastest_us(3, [&] { Store indexed; indexed.append(text); })); // Copy plus the index, as typing and reading do.
+		std::cout << "  " << path << ": scan " << scan << " GB/s, seek " << seek << " GB/s, append " << append << " GB/s" << (scanned == count && sought == text.rfind('\n') ? "" : " (wrong)") << "\n";
+	});
+}
+
+void bench_files(const std::string_view, const std::string_view filename) { // An 8GB copy of the file, loaded, scanned, edited and saved.
+	const auto store = load(filename);
+	if (!store) {
+		std::cerr << "files: can't read " << filename << "\n";
+		return;
+	}
+	const size_t size = 8 * GB;
+	std::string chunk;
+	while (chunk.size() + store->size() <= 64 * MB)
+		chunk.append(store->view());
+	const auto big = std::string(filename) + ".big";
+	struct Cleanup { // Both copies go, however far the case got.
+		const std::string& big;
+		~Cleanup() {
+			DeleteFileA(big.c_str());
+			DeleteFileA((big + ".tmp").c_str());
+		}
+	} cleanup{ big };
+	const auto seconds = [](int64_t us) { return us / 1000000.0; };
+	const auto rate = [&](int64_t us) { return size / (us * 1000.0); };
+
+	Timer timer;
+	bool written = false;
+	if (const auto file = CreateFileA(big.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr); file != INVALID_HANDLE_VALUE) {
+		written = true;
+		for (size_t done = 0; done < size && written; done += chunk.size())
+			written = write_chunks(file, std::string_view(chunk).substr(0, std::min(chunk.size(), size - done)));
+		CloseHandle(file);
+	}
+	if (!written) {
+		std::cerr << "files: can't write " << big << " (error " << GetLastError() << ")\n";
+		failures++;
+		return;
+	}
+	std::cout << "files: " << big << " " << size / GB << "GB\n";
+	std::cout << "  create: " << seconds(timer.get_elapsed_time_us()) << "s, " << rate(timer.get_elapsed_time_us()) << " GB/s\n";
+
+	{
+		Switcher switcher;
+		bool quit = false, maximize = false, fields = false;
+		double font_size = 16.0;
+		int scroll = 0;
+		timer = Timer();
+		switcher.open(big);
+		std::cout << "  open: " << timer.get_elapsed_time_us() << "us\n";
+		timer = Timer();
+		switcher.cull(240, 67, "bench", scroll); // A 4K window of 16px cells.
+		std::cout << "  first cull: " << timer.get_elapsed_time_us() << "us\n";
+
+		timer = Timer();
+		const auto matches = scan(big, "\x01"); // Never found, so every byte is compared.
+		std::cout << "  scan: " << seconds(timer.get_elapsed_time_us()) << "s, " << rate(timer.get_elapsed_time_us()) << " GB/s" << (matches.empty() ? "" : " (found)") << "\n";
+
+		switcher.process(false, quit, maximize, fields, font_size, 'x');
+		timer = Timer();
+		switcher.process(true, quit, maximize, fields, font_size, 's'); // Written aside, then in place.
+		std::error_code error;
+		const auto saved = std::filesystem::file_size(big, error);
+		std::cout << "  save: " << seconds(timer.get_elapsed_time_us()) << "s, " << rate(timer.get_elapsed_time_us()) << " GB/s, " << saved << " bytes" << (std::filesystem::exists(big + ".tmp") ? " (failed)" : "") << "\n";
+	}
+}
+
+void bench_blend(const std::string_view font, const std::string_view filename) { // Coverage rows blended over a 4K frame, then whole frames.
+	const unsigned width = 3840, height = 2160;
+	std::vector<Color> pixels((size_t)width * height, colors().clear);
+	std::vector<uint8_t> coverage(width);
+	for (unsigned i = 0; i < width; ++i) // Blank, edge and solid pixels, as in glyphs.
+		coverage[i] = i % 3 == 0 ? 0 : i % 3 == 1 ? (uint8_t)(i * 37) : 255;
+	const auto color = colors().text;
+	const auto rate = [&](int64_t us) { return (double)width * height / us; };
+	const auto blend = [&](unsigned row_width, auto func) { // Rows as wide as a glyph, or the frame.
+		return rate(fastest_us(10, [&] {
+			for (unsigned y = 0; y < height; ++y)
+				for (unsigned x = 0; x < width; x += row_width)
+					func(&pixels[(size_t)y * width + x], coverage.data(), (int)std::min(row_width, width - x));
+		}));
+	};
+	const auto scalar = [&](Color* out, const uint8_t* in, int count) {
+		auto c = color;
+		for (int i = 0; i < count; ++i)
+			out[i].blend(c.set_alpha(in[i]));
+	};
+
+	std::cout << "blend: " << width << "x" << height << " pixels, Mpixels/s in rows of 9 and " << width << "\n";
+	std::cout << "  scalar: " << blend(9, scalar) << ", " << blend(width, scalar) << "\n";
+	for_each_path([&](const char* path) {
+		const auto simd = [&](Color* out, const uint8_t* in, int count) { blend_row(out, in, count, color); };
+		std::cout << "  " << path << ": " << blend(9, simd) << ", " << blend(width, simd) << "\n";
+	});
+
+	Scene scene(font, filename);
+	if (!scene.is_valid())
+		return;
+	for_each_path([&](const char* path) {
+		std::cout << "  " << path << " full frame: " << scene.full_frame_us(20) << "us\n";
+	});
+}
+
+void bench_fill(const std::string_view font, const std::string_view) { // Solid cell spans, as BLOCK runs are drawn, over a 4K frame.
+	const unsigned width = 3840, height = 2160;
+	std::vector<Color> pixels((size_t)width * height, colors().clear);
+	Book book(font);
+	book.set_font_size(16.0);
+	const unsigned cell = std::max(book.get_character_width(), 1u);
+	const auto color = colors().highlight;
+	const auto rate = [&](int64_t us) { return (double)width * height / us; };
+	const auto fill = [&](unsigned span, auto func) { // One cell, or the whole row.
+		return rate(fastest_us(10, [&] {
+			for (unsigned y = 0; y < height; ++y)
+				for (unsigned x = 0; x < width; x += span)
+					func(&pixels[(size_t)y * width + x], (int)std::min(span, width - x));
+		}));
+	};
+	const auto scalar = [&](Color* out, int count) {
+		for (int i = 0; i < count; ++i)
+			out[i] = color;
+	};
+
+	std::cout << "fill: " << width << "x" << height << " pixels, Mpixels/s in spans of " << cell << " and " << width << "\n";
+	std::cout << "  scalar: " << fill(cell, scalar) << ", " << fill(width, scalar) << "\n";
+	for_each_path([&](const char* path) {
+		const auto simd = [&](Color* out, int count) { fill_row(out, count, color); };
+		std::cout << "  " << path << ": " << fill(cell, simd) << ", " << fill(width, simd) << "\n";
+	});
+	std::vector<uint8_t> coverage(cell, 255);
+	std::cout << "  blended cells: " << fill(cell, [&](Color* out, int count) { blend_row(out, coverage.data(), count, color); }) << "\n"; // How BLOCK was drawn before.
+}
+
+void bench_atlas(const std::string_view font, const std::string_view filename) { // Glyph lookups the renderer makes per cell, then whole frames.
+	Scene scene(font, filename);
+	if (!scene.is_valid())
+		return;
+	for (uint32_t c = 0x400; c < 0x500; ++c) // Cyrillic goes through the map, ASCII through the direct table.
+		scene.book.find_glyph(c);
+	const unsigned lookups = 1000000;
+	const auto lookup = [&](uint32_t first, uint32_t count) {
+		const auto us = fastest_us(5, [&] {
+			size_t sum = 0;
+			for (unsigned i = 0; i < lookups; ++i)
+				sum += scene.book.get_glyph(first + i % count).pixels.size();
+			sink = sum;
+		});
+		return us * 1000.0 / lookups;
+	};
+	std::cout << "atlas: ns per lookup\n";
+	std::cout << "  ascii: " << lookup(32, 95) << "\n";
+	std::cout << "  cyrillic: " << lookup(0x400, 256) << "\n";
+	std::cout << "  full frame: " << scene.full_frame_us(20) << "us\n";
+}
+
+void bench_workers(const std::string_view font, const std::string_view filename) { // Full frames with 0 to all of the worker threads helping.
+	Scene scene(font, filename);
+	if (!scene.is_valid())
+		return;
+	std::cout << "workers: full 4K frames, " << std::thread::hardware_concurrency() << " hardware threads\n";
+	int64_t single = 0;
+	for (unsigned count = 0; count <= workers().get_count(); ++count) {
+		workers().set_limit(count);
+		const auto us = scene.full_frame_us(20);
+		single = count == 0 ? us : single;
+		std::cout << "  " << count + 1 << " threads: " << us << "us, " << (double)single / us << "x\n";
+	}
+	workers().set_limit(UINT_MAX);
+}
+
+void bench_startup(const std::string_view font, const std::string_view filename) { // Time to the first frame, and to the first frame at a new size.
+	struct Step { const char* name; int64_t best = INT64_MAX; };
+	std::array<Step, 6> steps = { Step{ "open" }, Step{ "font" }, Step{ "frame" }, Step{ "cull" }, Step{ "render" }, Step{ "new size" } };
+	int64_t first = INT64_MAX, zoom = INT64_MAX, back = INT64_MAX;
+	for (unsigned run = 0; run < 10; ++run) { // New objects each run; only the OS file cache stays warm.
+		Timer total;
+		std::array<int64_t, 6> us = {};
+		const auto measure = [&](unsigned step, auto func) {
+			Timer timer;
+			func();
+			us[step] = timer.get_elapsed_time_us();
+		};
+		Switcher switcher;
+		measure(0, [&] { switcher.open(filename); });
+		std::optional<Book> book;
+		measure(1, [&] { book.emplace(font); book->set_font_size(16.0); }); // Glyphs every frame draws are rasterized here.
+		if (book->get_character_width() == 0 || book->get_line_height() == 0) {
+			std::cerr << "startup: " << font << " has no advance for code point 0\n";
+			return;
+		}
+		Frame frame;
+		Renderer renderer;
+		measure(2, [&] { frame.resize(3840, 2160); });
+		const auto frame_at = [&] { // Cull and render a full frame at the current size.
+			const unsigned col_count = frame.get_width() / book->get_character_width();
+			const unsigned row_count = frame.get_height() / book->get_line_height();
+			int scroll = 0;
+			Characters characters;
+			measure(3, [&] { characters = switcher.cull(col_count, row_count, "bench", scroll); });
+			measure(4, [&] { renderer.reset(); renderer.render(frame, *book, characters, col_count, row_count, 0); });
+		};
+		frame_at();
+		first = std::min(first, total.get_elapsed_time_us());
+		for (unsigned i = 0; i < 5; ++i)
+			steps[i].best = std::min(steps[i].best, us[i]);
+
+		Timer timer;
+		measure(5, [&] { book->set_font_size(17.0); });
+		frame_at();
+		zoom = std::min(zoom, timer.get_elapsed_time_us());
+		steps[5].best = std::min(steps[5].best, us[5]);
+		timer = Timer();
+		book->set_font_size(16.0); // From the recent sizes.
+		frame_at();
+		back = std::min(back, timer.get_elapsed_time_us());
+	}
+	std::cout << "startup: " << filename << " in a 4K frame at 16px, best of 10\n";
+	for (auto& step : steps) {
+		std::cout << "  " << step.name << ": " << step.best << "us\n";
+	}
+	std::cout << "  first frame: " << first << "us\n";
+	std::cout << "  first frame at 17px: " << zoom << "us, back at 16px: " << back << "us\n";
+}
+
+void bench_glyphs(const std::string_view font, const std::string_view) { // Rasterization throughput from decoded outlines, by size.
+	Font source(font);
+	Outlines outlines;
+	std::vector<uint8_t> image;
+	rasterize_glyphs(source, outlines, 80.0, image); // Decode the outlines and grow the buffers.
+	std::cout << "glyphs: Latin and Cyrillic, glyphs/s\n";
+	for (double size : { 8.0, 12.0, 16.0, 24.0, 32.0, 48.0, 64.0, 80.0 }) {
+		size_t count = 0;
+		const auto us = fastest_us(5, [&] { count = rasterize_glyphs(source, outlines, size, image); });
+		std::cout << "  " << (int)size << "px: " << (int64_t)(count * 1000000.0 / us) << "\n";
+	}
+}
+
+struct Case {
+	const char* name;
+	void (*run)(const std::string_view font, const std::string_view filename);
+	bool named = false; // Only runs when asked for by name.
+};
+
+static inline const Case cases[] = {
+	{ "frames", bench_frames },
+	{ "allocations", bench_allocations },
+	{ "newlines", bench_newlines },
+	{ "files", bench_files, true }, // Needs 16GB of disk next to the file while saving.
+	{ "blend", bench_blend },
+	{ "atlas", bench_atlas },
+	{ "fill", bench_fill },
+	{ "workers", bench_workers },
+	{ "startup", bench_startup },
+	{ "glyphs", bench_glyphs },
+};
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cerr << "usage: bench <font.ttf> <file> [case]\n";
+		return 1;
+	}
+	if (!std::filesystem::exists(argv[1])) {
+		std::cerr << "no font " << argv[1] << "\n";
+		return 1;
+	}
+	const auto name = std::string_view(argc > 3 ? argv[3] : "");
+	std::cout << std::fixed << std::setprecision(2);
+	bool found = false;
+	for (const auto& c : cases) {
+		if (name.empty() ? !c.named : name == c.name) {
+			c.run(argv[1], argv[2]);
+			found = true;
+		}
+	}
+	if (!found) {
+		std::cerr << "no case " << name << "\n";
+		return 1;
+	}
+	return failures > 0 ? 1 : 0;
+}
+
@@ -51,6 +51,29 @@ class Buffer {
 	bool word_strict = false;
 
 	bool needs_save = false;
+	size_t saved_generation = 0;
+
+	struct Run { // Cells of one screen row from its first text column on.
+		size_t end = 0; // Text offset after the row.
+		unsigned col = 0; // Column after the last cell.
+		bool newline = false;
+		Characters characters;
+	};
+
+	struct Runs { // Reused while the text, width and highlight they were culled with stay the same.
+		size_t generation = (size_t)-1;
+		unsigned col_count = 0;
+		std::string highlight;
+		bool strict = false;
+		bool search = false;
+		std::unordered_map<size_t, Run> rows; // By text offset of the row's first character.
+	};
+
+	mutable Runs runs;
+
+	mutable std::vector<size_t> row_offsets; // Text offset where each screen row of the last cull starts.
+	mutable size_t offsets_generation = (size_t)-1;
+	mutable int scroll = 0; // Screen rows the view moved down by since the last cull.
 
 	State& state() { return stack.state(); }
 	const State& state() const { return stack.state(); }
@@ -101,7 +124,7 @@ class Buffer {
 	}
 
 	bool check_highlight_loose(size_t index) const {
-		return state().get_text().substr(index, highlight.size()) == highlight;
+		return state().get_text().matches(index, highlight);
 	}
 
 	void line_find() {
@@ -195,7 +218,7 @@ class Buffer {
 		};
 
 		if (mode != Mode::insert) {
-			needs_save = stack.pop() || needs_save;
+			stack.pop();
 		}
 	}
 
@@ -481,32 +504,84 @@ class Buffer {
 			colors().cursor, row, col);
 	};
 
-	void push_char_text(Characters& characters, unsigned row, unsigned col, char c, unsigned index) const {
+	void push_char_text(Characters& characters, unsigned row, unsigned col, char c, size_t index) const {
 		if (index == state().get_cursor() && mode == Mode::normal) { characters.emplace_back((uint16_t)c, colors().text_cursor, row, col); }
 		else { characters.emplace_back((uint16_t)c, colors().text, row, col); }
 	};
 
+	void prepare_runs(unsigned col_count, unsigned row_count) const { // Drops runs whose inputs changed, and the ones an edit may reach.
+		const auto generation = state().get_generation();
+		const bool search = is_mode_search();
+		if (runs.col_count != col_count || runs.highlight != highlight || runs.strict != word_strict || runs.search != search ||
+			runs.rows.size() > 4 * (size_t)row_count) { // Bounded while scrolling.
+			runs.rows.clear();
+			runs.col_count = col_count;
+			runs.highlight = highlight;
+			runs.strict = word_strict;
+			runs.search = search;
+		}
+		else if (runs.generation != generation) { // Rows before the first edited line keep their text and offsets.
+			const auto& text = state().get_text();
+			const auto changed = state().changed_since(runs.generation);
+			const auto newline = changed > 0 && changed != std::string::npos ? text.rfind("\n", changed - 1) : std::string::npos;
+			const auto line_begin = changed == std::string::npos ? changed : newline != std::string::npos ? newline + 1 : 0;
+			std::erase_if(runs.rows, [&](const auto& row) { return row.second.end + highlight.size() > line_begin; }); // Highlight matches read past the row.
+		}
+		runs.generation = generation;
+	}
+
 	unsigned push_text(Characters& characters, unsigned col_count, unsigned row_count) const {
 		const unsigned cursor_row = state().find_cursor_row();
 		const unsigned begin_row = state().get_begin_row();
-		unsigned absolute_row = 0;
-		unsigned index = 0;
+		const size_t cursor = state().get_cursor();
+		const auto& text = state().get_text();
+		size_t index = state().get_begin_offset();
+		unsigned absolute_row = begin_row;
 		unsigned row = 2;
 		unsigned col = 0;
-		for (auto& c : state().get_text()) {
-			if (absolute_row < begin_row) {
-				if (c == '\n') { absolute_row++; }
+		prepare_runs(col_count, row_count);
+		size_t run_begin = std::string::npos; // Row being recorded, and its first cell.
+		size_t run_first = 0;
+		const auto end_run = [&](size_t end, bool newline) {
+			if (run_begin != std::string::npos && !(cursor >= run_begin && cursor < end)) { // The cursor row changes with every motion.
+				auto& run = runs.rows[run_begin];
+				run.end = end;
+				run.col = col;
+				run.newline = newline;
+				run.characters.assign(characters.begin() + run_first, characters.end());
 			}
-			else if (absolute_row >= begin_row && (row - 1) <= row_count - 2) {
-				if (col == col_count) { row++; col = 7; }
+			run_begin = std::string::npos;
+		};
+		std::vector<size_t> offsets;
+		auto it = text.at(index);
+		while (it != text.end()) {
+			const char c = *it;
+			if ((row - 1) <= row_count - 2) {
+				if (col == col_count) { end_run(index, false); row++; col = 7; }
+				if (col == 0 || col == 7) { offsets.push_back(index); }
 				if (col == 0 && absolute_row == cursor_row) { push_cursor_line(characters, row, col_count); }
 				if (col == 0 && absolute_row != cursor_row) { push_column_indicator(characters, row, 87); }
 				if (col == 0) { push_line_number(characters, row, col, absolute_row, cursor_row); col += 6; }
 				if (col == 6) { push_line_indicator(characters, row, col); col += 1; }
+				if (col == 7 && col_count > 7 && row + 1 <= row_count) { // Start of a row that fits whole: reuse its cells or record them.
+					if (const auto found = runs.rows.find(index); found != runs.rows.end() && !(cursor >= index && cursor < found->second.end)) {
+						const auto& run = found->second;
+						for (const auto& character : run.characters) {
+							characters.emplace_back(character.index, character.color, row, character.col);
+						}
+						index = run.end;
+						col = run.col;
+						if (run.newline) { absolute_row++; row++; col = 0; }
+						it = text.at(index);
+						continue;
+					}
+					run_begin = index;
+					run_first = characters.size();
+				}
 				if (word_strict) { if (auto match = check_highlight_strict(index); match.first) { push_highlight_one(characters, row, col, match.second); } }
 				else { if (check_highlight_loose(index)) { push_highlight(characters, row, col); } }
-				if (index == state().get_cursor()) { push_cursor(characters, row, col); }
-				if (c == '\n') { push_return(characters, row, col); absolute_row++; row++; col = 0; }
+				if (index == cursor) { push_cursor(characters, row, col); }
+				if (c == '\n') { push_return(characters, row, col); end_run(index + 1, true); absolute_row++; row++; col = 0; }
 				else if (c == '\t') { push_tab(characters, row, col); col += 3; }
 				else if (c == '\r') { push_carriage(characters, row, col); col++; }
 				else if (c == ' ') { push_space(characters, row, col); col++; }
@@ -516,18 +591,39 @@ class Buffer {
 				break;
 			}
 			index++;
+			++it;
 		}
+		end_run(index, false);
+		update_scroll(std::move(offsets));
 		return absolute_row > begin_row ? absolute_row - begin_row - 1 : 0;
 	}
 
+	void update_scroll(std::vector<size_t> offsets) const { // Finds the first row of one cull among the rows of the other.
+		scroll = 0;
+		if (offsets_generation == state().get_generation() && !row_offsets.empty() && !offsets.empty()) {
+			if (const auto found = std::lower_bound(row_offsets.begin(), row_offsets.end(), offsets.front()); found != row_offsets.end() && *found == offsets.front())
+				scroll = (int)(found - row_offsets.begin());
+			else if (const auto found = std::lower_bound(offsets.begin(), offsets.end(), row_offsets.front()); found != offsets.end() && *found == row_offsets.front())
+				scroll = -(int)(found - offsets.begin());
+		}
+		row_offsets = std::move(offsets);
+		offsets_generation = state().get_generation();
+	}
+
 public:
 	Buffer(const std::string_view filename)
 		: filename(filename) {
 	}
 
-	void init(const std::string_view text) {
+	template <typename T>
+	void init(const T& text) {
 		stack.set_cursor(0);
 		stack.set_text(text);
+		set_dirty(false);
+	}
+
+	void rebase(std::shared_ptr<const Store> store) {
+		stack.rebase(store);
 	}
 
 	void append(const std::string_view text) {
@@ -544,6 +640,8 @@ public:
 		return push_text(characters, col_count, row_count);
 	}
 
+	int get_scroll() const { return scroll; }
+
 	const std::string status() const {
 		switch (mode) {
 		case Mode::normal_question: return "?" + highlight;
@@ -571,14 +669,14 @@ public:
 	std::string get_url() const { return state().get_url(); }
 	std::string get_line_url() const { return state().get_line_url(); }
 	std::string get_word() const { return state().get_word(); }
-	std::string_view get_text() const { return state().get_text(); }
+	const Table& get_text() const { return state().get_text(); }
 
 	bool is_normal() const { return mode == Mode::normal; }
 
 	void set_highlight(const std::string_view pattern) { highlight = pattern; word_forward = true; }
 	void clear_highlight() { highlight.clear(); }
 
-	void set_dirty(bool b) { needs_save = b; }
-	bool is_dirty() const { return needs_save; }
+	void set_dirty(bool b) { needs_save = b; saved_generation = state().get_generation(); }
+	bool is_dirty() const { return needs_save || state().get_generation() != saved_generation; }
 };
 
@@ -22,27 +22,16 @@ std::string readable_size(size_t size) {
 }
 
 class Timer {
-	long long performance_frequency = 0;
-	int64_t start_time = 0;
-
-	int64_t get_time_ms() const {
-		LARGE_INTEGER counter;
-		QueryPerformanceCounter(&counter);
-		return (counter.QuadPart * 1000) / performance_frequency;
-	}
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
 
 public:
-	Timer() {
-		LARGE_INTEGER perf_freq;
-		QueryPerformanceFrequency(&perf_freq);
-		performance_frequency = perf_freq.QuadPart;
-		start_time = get_time_ms();
-	}
-
 	int64_t get_elapsed_time_ms() const {
-		return get_time_ms() - start_time;
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
 	}
 
+	int64_t get_elapsed_time_us() const {
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count();
+	}
 };
 
 bool ignore_file(const std::string_view path) {
@@ -87,15 +76,43 @@ void process_files(const std::string& path, F func) {
 	FindClose(handle);
 }
 
+bool get_file_size(HANDLE file, size_t& size) { // Fails rather than truncate when size_t is too small.
+	LARGE_INTEGER large = {};
+	if (!GetFileSizeEx(file, &large) || (unsigned long long)large.QuadPart > (unsigned long long)SIZE_MAX)
+		return false;
+	size = (size_t)large.QuadPart;
+	return true;
+}
+
+struct View { // Window of a mapped file, overlapping its neighbours so matches near the edges keep their context.
+	const char* mem = nullptr;
+	size_t offset = 0; // File position of mem[0].
+	size_t size = 0;
+	size_t begin = 0; // File range this view is responsible for.
+	size_t end = 0;
+};
+
+static inline constexpr size_t view_size = 256 * MB;
+static inline constexpr size_t view_margin = 64 * KB; // Multiple of the allocation granularity.
+
 template <typename F>
 void map(const std::string_view filename, F func) {
 	if (const auto file = CreateFileA(filename.data(), GENERIC_READ, FILE_SHARE_READ, nullptr,
 		OPEN_EXISTING, FILE_ATTRIBUTE_READONLY | FILE_FLAG_SEQUENTIAL_SCAN, nullptr); file != INVALID_HANDLE_VALUE) {
-		if (size_t size = 0; GetFileSizeEx(file, (PLARGE_INTEGER)&size)) {
-			if (const auto mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr); mapping != INVALID_HANDLE_VALUE) {
-				if (const auto mem = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0); mem != nullptr) {
-					func((char*)mem, size);
-					UnmapViewOfFile(mem);
+		if (size_t size = 0; get_file_size(file, size) && size > 0) {
+			if (const auto mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr); mapping != nullptr) {
+				for (size_t begin = 0; begin < size; begin += view_size) {
+					View view;
+					view.begin = begin;
+					view.end = std::min(begin + view_size, size);
+					view.offset = begin > 0 ? begin - view_margin : 0;
+					view.size = std::min(view.end + view_margin, size) - view.offset;
+					const auto offset = (unsigned long long)view.offset;
+					if (const auto mem = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(offset >> 32), (DWORD)offset, view.size); mem != nullptr) {
+						view.mem = (const char*)mem;
+						func(view);
+						UnmapViewOfFile(mem);
+					}
 				}
 				CloseHandle(mapping);
 			}
@@ -104,11 +121,33 @@ void map(const std::string_view filename, F func) {
 	}
 }
 
-bool write(const std::string_view filename, const std::string_view text) {
+static inline constexpr size_t write_batch = 1 * MB;
+
+bool write_chunks(HANDLE file, std::string_view s) { // WriteFile takes at most 4GB at once.
+	while (s.size() > 0) {
+		DWORD written = 0;
+		if (!WriteFile(file, s.data(), (DWORD)std::min(s.size(), (size_t)1 * GB), &written, nullptr) || written == 0)
+			return false;
+		s.remove_prefix(written);
+	}
+	return true;
+}
+
+bool write(const std::string_view filename, const Table& text, DWORD disposition = CREATE_ALWAYS) { // TRUNCATE_EXISTING rewrites the file in place.
 	bool res = false;
 	if (const auto file = CreateFileA(filename.data(), GENERIC_WRITE, 0, nullptr,
-		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr); file != INVALID_HANDLE_VALUE) {
-		res = WriteFile(file, text.data(), (DWORD)text.size(), nullptr, nullptr);
+		disposition, FILE_ATTRIBUTE_NORMAL, nullptr); file != INVALID_HANDLE_VALUE) {
+		res = true;
+		std::string pending; // Small pieces are batched into fewer writes.
+		text.process_pieces([&](const std::string_view piece) {
+			if (pending.size() + piece.size() > write_batch) {
+				res = res && write_chunks(file, pending);
+				pending.clear();
+			}
+			if (piece.size() > write_batch) { res = res && write_chunks(file, piece); }
+			else { pending += piece; }
+		});
+		res = res && write_chunks(file, pending);
 		CloseHandle(file);
 	}
 	return res;
@@ -135,20 +174,20 @@ std::string make_line(const std::string_view text) {
 	return std::string(text) + "\n";
 }
 
-std::string make_entry(size_t pos, const char* mem, size_t size) {
+std::string make_entry(size_t pos, const char* mem, size_t size, size_t offset) {
 	const auto start = pos > (size_t)100 ? pos - (size_t)100 : (size_t)0;
 	const auto count = std::min((size_t)200, size - start);
 	const auto context = std::string(&mem[start], count);
-	return "(" + std::to_string(pos) + ") " + make_line(cut_line(context, pos - start));
+	return "(" + std::to_string(offset + pos) + ") " + make_line(cut_line(context, pos - start));
 }
 
 std::string scan(const std::string_view path, const std::string_view pattern) {
 	std::string list;
-	map(path, [&](const char* mem, size_t size) {
-		for (size_t i = 0; i < size; ++i) {
-			if (mem[i] == pattern[0]) {
-				if (strncmp(&mem[i], pattern.data(), std::min(pattern.size(), size - i)) == 0) {
-					list += std::string(path) + make_entry(i, mem, size);
+	map(path, [&](const View& view) {
+		for (size_t i = view.begin - view.offset; i < view.end - view.offset; ++i) {
+			if (view.mem[i] == pattern[0]) {
+				if (strncmp(&view.mem[i], pattern.data(), std::min(pattern.size(), view.size - i)) == 0) {
+					list += std::string(path) + make_entry(i, view.mem, view.size, view.offset);
 				}
 			}
 		}
@@ -168,73 +207,72 @@ std::string find(const std::string_view pattern) {
 	return list;
 }
 
-std::string load(const std::string_view filename) {
-	std::string text = "\n";
-	if (std::filesystem::exists(filename)) {
-		map(filename, [&](const char* mem, size_t size) {
-			text = std::string(mem, size);
-		});
+static inline constexpr size_t read_batch = 64 * MB;
+
+std::shared_ptr<const Store> read_store(HANDLE file, size_t size) { // Copied, for files another process is writing to.
+	auto store = std::make_shared<Store>();
+	std::string chunk(std::min(size, read_batch), 0);
+	for (size_t done = 0; done < size;) {
+		DWORD read = 0;
+		if (!ReadFile(file, chunk.data(), (DWORD)std::min(size - done, chunk.size()), &read, nullptr))
+			return nullptr;
+		if (read == 0)
+			break; // Truncated while reading.
+		store->append(std::string_view(chunk.data(), read));
+		done += read;
 	}
-	return text;
+	return store;
 }
 
-std::string get_user_font_path() {
-	char path[MAX_PATH];
-	if (const auto res = SHGetSpecialFolderPathA(NULL, path, CSIDL_LOCAL_APPDATA, FALSE))
-		return std::string(path) + "\\Microsoft\\Windows\\Fonts\\";
-	return "";
-}
-
-std::string get_system_font_path() {
-	char win_dir[MAX_PATH];
-	if (const auto len = GetWindowsDirectoryA(win_dir, MAX_PATH)) {
-		std::stringstream ss;
-		ss << win_dir << "\\Fonts\\";
-		return ss.str();
+std::shared_ptr<const Store> map_store(HANDLE file, size_t size) {
+	std::shared_ptr<const Store> store;
+	if (const auto mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr); mapping != nullptr) {
+		if (const auto mem = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0); mem != nullptr) { // One view, so needs a 64-bit build past a few GB.
+			store = std::make_shared<Store>(std::shared_ptr<const char>((const char*)mem, [](const char* mem) { UnmapViewOfFile(mem); }), size);
+		}
+		CloseHandle(mapping); // The view keeps the mapping alive.
 	}
-	return "";
+	return store;
 }
 
-std::string get_system_font_name(const std::string& face_name) {
-	HKEY hkey;
-	static const char* registry = "Software\\Microsoft\\Windows NT\\CurrentVersion\\Fonts";
-	auto result = RegOpenKeyExA(HKEY_LOCAL_MACHINE, registry, 0, KEY_READ, &hkey);
-	if (result != ERROR_SUCCESS)
-		return "";
-
-	DWORD name_max_size, data_max_size;
-	result = RegQueryInfoKey(hkey, 0, 0, 0, 0, 0, 0, 0, &name_max_size, &data_max_size, 0, 0);
-	if (result != ERROR_SUCCESS)
-		return "";
-
-	DWORD index = 0;
-	std::vector<char> name(name_max_size);
-	std::vector<BYTE> data(data_max_size);
-	std::string font;
+std::shared_ptr<const Store> copy_store(const Table& text) {
+	auto store = std::make_shared<Store>();
+	text.process_pieces([&](const std::string_view piece) { store->append(piece); });
+	return store;
+}
 
-	do {
-		DWORD data_size = data_max_size;
-		DWORD name_size = name_max_size;
-		DWORD type;
-		const auto result = RegEnumValueA(hkey, index++, name.data(), &name_size, 0, &type, data.data(), &data_size);
-		if (result != ERROR_SUCCESS || type != REG_SZ)
-			continue;
-
-		std::string font_name(name.data(), name_size);
-		if (_strnicmp(face_name.c_str(), font_name.c_str(), face_name.length()) == 0) {
-			font.assign((LPSTR)data.data(), data_size);
-			break;
+std::shared_ptr<const Store> read_file(const std::string_view filename) { // Null if the file can't be read.
+	std::shared_ptr<const Store> store;
+	auto file = CreateFileA(filename.data(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_READONLY, nullptr);
+	const bool shared = file == INVALID_HANDLE_VALUE && GetLastError() == ERROR_SHARING_VIOLATION; // Open for writing elsewhere, so a mapping could change under us.
+	if (shared)
+		file = CreateFileA(filename.data(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_READONLY, nullptr);
+	if (file != INVALID_HANDLE_VALUE) {
+		if (size_t size = 0; get_file_size(file, size)) {
+			if (!shared && size > 0)
+				store = map_store(file, size); // Text is read from the mapping, never copied.
+			if (!store)
+				store = read_store(file, size);
 		}
-	} while (result != ERROR_NO_MORE_ITEMS);
-
-	RegCloseKey(hkey);
+		CloseHandle(file);
+	}
+	return store;
+}
 
-	return font;
+std::shared_ptr<const Store> load(const std::string_view filename) { // Null if the file exists but can't be read.
+	if (std::filesystem::exists(filename))
+		if (auto store = read_file(filename); !store || store->size() > 0)
+			return store;
+	auto store = std::make_shared<Store>();
+	store->append("\n");
+	return store;
 }
 
 class File {
 	const uint8_t* memory = nullptr;
-	uint_fast32_t size = 0;
+	size_t size = 0;
 	HANDLE mapping = nullptr;
 
 public:
@@ -242,11 +280,8 @@ public:
 	File(const std::string_view filename) {
 		const auto file = CreateFileA(filename.data(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
 		if (file != INVALID_HANDLE_VALUE) {
-			DWORD high = 0;
-			const auto low = GetFileSize(file, &high);
-			if (low != INVALID_FILE_SIZE) {
-				size = (size_t)high << (8 * sizeof(DWORD)) | low;
-				mapping = CreateFileMapping(file, NULL, PAGE_READONLY, high, low, NULL);
+			if (get_file_size(file, size)) {
+				mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
 				if (mapping) {
 					memory = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
 				}
@@ -264,7 +299,7 @@ public:
 		}
 	}
 
-	uint_fast32_t get_size() const { return size; }
+	size_t get_size() const { return size; }
 	const uint8_t* get_memory() const { return memory; }
 };
 
@@ -126,8 +126,8 @@ struct Curve {
 	uint_least16_t beg = 0, end = 0, ctrl = 0;
 };
 
-struct Cell {
-	double area = 0.0, cover = 0.0;
+struct Cell { // Float halves the accumulation buffer, enough for glyph-sized sums.
+	float area = 0.0f, cover = 0.0f;
 };
 
 struct Raster {
@@ -138,16 +138,36 @@ struct Raster {
 
 /* Integrate the values in the buffer to arrive at the final grayscale image. */
 static void post_process(const Raster& buf, uint8_t* image) {
-	Cell cell;
-	double accum = 0.0, value;
-	unsigned int num = (unsigned int)buf.width * (unsigned int)buf.height;
-	for (unsigned i = 0; i < num; ++i) {
-		cell = buf.cells[i];
-		value = fabs(accum + cell.area);
-		value = std::min(value, 1.0);
-		value = value * 255.0 + 0.5;
-		image[i] = (uint8_t)value;
-		accum += cell.cover;
+	const unsigned num = (unsigned)buf.width * (unsigned)buf.height;
+	const float* cells = &buf.cells[0].area;
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	__m128 accum = _mm_setzero_ps();
+	unsigned i = 0;
+	for (; i + 4 <= num; i += 4) { // Exclusive prefix sum of 4 covers in register.
+		const __m128 lo = _mm_loadu_ps(cells + i * 2);
+		const __m128 hi = _mm_loadu_ps(cells + i * 2 + 4);
+		const __m128 area = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 cover = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+		__m128 before = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(cover), 4));
+		before = _mm_add_ps(before, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(before), 4)));
+		before = _mm_add_ps(before, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(before), 8)));
+		__m128 value = _mm_andnot_ps(sign, _mm_add_ps(_mm_add_ps(accum, before), area));
+		value = _mm_add_ps(_mm_mul_ps(_mm_min_ps(value, one), scale), half);
+		const __m128i words = _mm_packs_epi32(_mm_cvttps_epi32(value), _mm_setzero_si128());
+		const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+		memcpy(image + i, &bytes, 4);
+		const __m128 total = _mm_add_ps(before, cover);
+		accum = _mm_add_ps(accum, _mm_shuffle_ps(total, total, _MM_SHUFFLE(3, 3, 3, 3)));
+	}
+	float sum = _mm_cvtss_f32(accum);
+	for (; i < num; ++i) {
+		const Cell cell = buf.cells[i];
+		const float value = std::min(fabsf(sum + cell.area), 1.0f);
+		image[i] = (uint8_t)(value * 255.0f + 0.5f);
+		sum += cell.cover;
 	}
 }
 
@@ -214,9 +234,9 @@ static void draw_line(Raster& buf, const Point& origin, const Point& goal) {
 		yDifference = (nextDistance - prevDistance) * delta.y;
 		cptr = &buf.cells[pixel.y * buf.width + pixel.x];
 		cell = *cptr;
-		cell.cover += yDifference;
+		cell.cover += (float)yDifference;
 		xAverage -= (double)pixel.x;
-		cell.area += (1.0 - xAverage) * yDifference;
+		cell.area += (float)((1.0 - xAverage) * yDifference);
 		*cptr = cell;
 		prevDistance = nextDistance;
 		int alongX = nextCrossing.x < nextCrossing.y;
@@ -231,9 +251,9 @@ static void draw_line(Raster& buf, const Point& origin, const Point& goal) {
 	yDifference = (1.0 - prevDistance) * delta.y;
 	cptr = &buf.cells[pixel.y * buf.width + pixel.x];
 	cell = *cptr;
-	cell.cover += yDifference;
+	cell.cover += (float)yDifference;
 	xAverage -= (double)pixel.x;
-	cell.area += (1.0 - xAverage) * yDifference;
+	cell.area += (float)((1.0 - xAverage) * yDifference);
 	*cptr = cell;
 }
 
@@ -264,6 +284,22 @@ struct Font {
 	double descender = 0.0;
 	double lineGap = 0.0;
 
+	uint_fast32_t hhea = 0; // Table offsets, resolved once. 0 if missing.
+	uint_fast32_t hmtx = 0;
+	uint_fast32_t loca = 0;
+	uint_fast32_t glyf = 0;
+
+	struct Range { // Supplementary plane cmap group.
+		uint_least32_t firstCode = 0;
+		uint_least32_t lastCode = 0;
+		uint_least32_t glyphOffset = 0;
+	};
+
+	static inline constexpr uint_least16_t missing = 0xFFFF; // Past the last glyph numGlyphs can address.
+
+	std::vector<uint_least16_t> bmp; // Glyph of each BMP code point (or missing if the lookup failed), empty if no usable cmap.
+	std::vector<Range> ranges; // Sorted by firstCode.
+
 	uint_least8_t getu8(uint_fast32_t offset) const {
 		assert(offset + 1 <= file.get_size());
 		return *(file.get_memory() + offset);
@@ -311,10 +347,7 @@ struct Font {
 	}
 
 	int lmetrics() {
-		uint_fast32_t hhea;
-		if (gettable((char*)"hhea", &hhea) < 0)
-			return -1;
-		if (!is_safe_offset(hhea, 36))
+		if (!hhea || !is_safe_offset(hhea, 36))
 			return -1;
 		const double factor = yScale / unitsPerEm;
 		ascender = geti16(hhea + 4) * factor;
@@ -341,12 +374,16 @@ struct Font {
 		unitsPerEm = getu16(head + 18);
 		locaFormat = geti16(head + 50);
 
-		uint_fast32_t hhea;
 		if (gettable((char*)"hhea", &hhea) < 0)
 			return;
 		if (!is_safe_offset(hhea, 36))
 			return;
 		numLongHmtx = getu16(hhea + 34);
+
+		gettable((char*)"hmtx", &hmtx);
+		gettable((char*)"loca", &loca);
+		gettable((char*)"glyf", &glyf);
+		load_cmap();
 	}
 
 	bool set_size(double size) {
@@ -359,16 +396,17 @@ struct Font {
 		return false;
 	}
 
+	double get_size() const { return xScale; }
 	unsigned get_line_height() const { return (unsigned)(yScale - descender); }
 	unsigned get_line_baseline() const { return (unsigned)ascender; }
 
-	Metrics get_metrics(const uint_fast32_t glyph_id) const {
+	Metrics get_metrics(const uint_fast32_t glyph_id, double size) const { // At any size, so one Font serves them all.
 		int adv, lsb;
 		if (hor_metrics(glyph_id, &adv, &lsb) < 0)
 			return {};
 
 		Metrics metrics;
-		const double xscale = xScale / unitsPerEm;
+		const double xscale = size / unitsPerEm;
 		metrics.advanceWidth = adv * xscale;
 		metrics.leftSideBearing = lsb * xscale + xOffset;
 
@@ -379,7 +417,7 @@ struct Font {
 			return metrics;
 
 		int bbox[4];
-		if (glyph_bbox(outline, bbox) < 0)
+		if (glyph_bbox(outline, size, bbox) < 0)
 			return {};
 
 		metrics.minWidth = bbox[2] - bbox[0] + 1;
@@ -389,8 +427,8 @@ struct Font {
 	}
 
 	int hor_metrics(uint_fast32_t glyph_id, int* advanceWidth, int* leftSideBearing) const {
-		uint_fast32_t hmtx, offset, boundary;
-		if (gettable((char*)"hmtx", &hmtx) < 0)
+		uint_fast32_t offset, boundary;
+		if (!hmtx)
 			return -1;
 		if (glyph_id < numLongHmtx) {
 			/* glyph is inside long metrics segment. */
@@ -422,12 +460,9 @@ struct Font {
 
 	/* Returns the offset into the font that the glyph's outline is stored at. */
 	int outline_offset(uint_fast32_t glyph_id, uint_fast32_t* offset) const {
-		uint_fast32_t loca, glyf;
 		uint_fast32_t base, current, next;
 
-		if (gettable((char*)"loca", &loca) < 0)
-			return -1;
-		if (gettable((char*)"glyf", &glyf) < 0)
+		if (!loca || !glyf)
 			return -1;
 
 		if (locaFormat == 0) {
@@ -591,61 +626,58 @@ struct Font {
 		return 0;
 	}
 
-	int cmap_fmt12_13(uint_fast32_t table, uint_least32_t charCode, uint_fast32_t* glyph_id, int which) const {
-		uint32_t len, numEntries;
-		uint_fast32_t i;
-
-		*glyph_id = 0;
-
-		/* check that the entire header is present */
+	void load_groups(uint_fast32_t table) { // Format 12, in file order so earlier groups win.
 		if (!is_safe_offset(table, 16))
-			return -1;
-
-		len = getu32(table + 4);
-
-		/* A minimal header is 16 bytes */
-		if (len < 16)
-			return -1;
-
-		if (!is_safe_offset(table, len))
-			return -1;
-
-		numEntries = getu32(table + 12);
-
-		for (i = 0; i < numEntries; ++i) {
-			uint32_t firstCode, lastCode, glyphOffset;
-			firstCode = getu32(table + (i * 12) + 16);
-			lastCode = getu32(table + (i * 12) + 16 + 4);
-			if (charCode < firstCode || charCode > lastCode)
-				continue;
-			glyphOffset = getu32(table + (i * 12) + 16 + 8);
-			if (which == 12)
-				*glyph_id = (charCode - firstCode) + glyphOffset;
-			else
-				*glyph_id = glyphOffset;
-			return 0;
+			return;
+		const uint32_t len = getu32(table + 4);
+		if (len < 16 || !is_safe_offset(table, len))
+			return;
+		const uint32_t numEntries = getu32(table + 12);
+		if (numEntries > (len - 16) / 12)
+			return;
+		bmp.assign(0x10000, 0);
+		std::vector<bool> found(0x10000, false);
+		for (uint_fast32_t i = 0; i < numEntries; ++i) {
+			Range range;
+			range.firstCode = getu32(table + (i * 12) + 16);
+			range.lastCode = getu32(table + (i * 12) + 16 + 4);
+			range.glyphOffset = getu32(table + (i * 12) + 16 + 8);
+			for (uint_least32_t code = range.firstCode; code <= std::min(range.lastCode, (uint_least32_t)0xFFFF); ++code) {
+				if (!found[code]) {
+					bmp[code] = (uint_least16_t)((code - range.firstCode) + range.glyphOffset);
+					found[code] = true;
+				}
+			}
+			if (range.lastCode > 0xFFFF)
+				ranges.push_back(range);
 		}
+		std::stable_sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.firstCode < b.firstCode; });
+	}
 
-		return 0;
+	template <typename F>
+	void load_bmp(F lookup) {
+		bmp.assign(0x10000, 0);
+		for (uint_least32_t code = 0; code <= 0xFFFF; ++code) {
+			uint_fast32_t id = 0;
+			bmp[code] = lookup(code, &id) == 0 ? (uint_least16_t)id : missing;
+		}
 	}
 
-	/* Maps Unicode code points to glyph indices. */
-	int glyph_id(uint_least32_t charCode, uint_fast32_t* glyph_id) const {
+	/* Builds the code point to glyph index tables. */
+	void load_cmap() {
 		uint_fast32_t cmap, entry, table;
 		unsigned int idx, numEntries;
-		int type, format;
-
-		*glyph_id = 0;
+		int type;
 
 		if (gettable((char*)"cmap", &cmap) < 0)
-			return -1;
+			return;
 
 		if (!is_safe_offset(cmap, 4))
-			return -1;
+			return;
 		numEntries = getu16(cmap + 2);
 
 		if (!is_safe_offset(cmap, 4 + numEntries * 8))
-			return -1;
+			return;
 
 		/* First look for a 'full repertoire'/non-BMP map. */
 		for (idx = 0; idx < numEntries; ++idx) {
@@ -654,16 +686,9 @@ struct Font {
 			/* Complete unicode map */
 			if (type == 0004 || type == 0312) {
 				table = cmap + getu32(entry + 4);
-				if (!is_safe_offset(table, 8))
-					return -1;
-				/* Dispatch based on cmap format. */
-				format = getu16(table);
-				switch (format) {
-				case 12:
-					return cmap_fmt12_13(table, charCode, glyph_id, 12);
-				default:
-					return -1;
-				}
+				if (is_safe_offset(table, 8) && getu16(table) == 12)
+					load_groups(table);
+				return;
 			}
 		}
 
@@ -675,23 +700,40 @@ struct Font {
 			if (type == 0003 || type == 0301) {
 				table = cmap + getu32(entry + 4);
 				if (!is_safe_offset(table, 6))
-					return -1;
+					return;
 				/* Dispatch based on cmap format. */
 				switch (getu16(table)) {
 				case 4:
-					return cmap_fmt4(table + 6, charCode, glyph_id);
+					load_bmp([&](uint_least32_t code, uint_fast32_t* id) { return cmap_fmt4(table + 6, code, id); });
+					return;
 				case 6:
-					return cmap_fmt6(table + 6, charCode, glyph_id);
+					load_bmp([&](uint_least32_t code, uint_fast32_t* id) { return cmap_fmt6(table + 6, code, id); });
+					return;
 				default:
-					return -1;
+					return;
 				}
 			}
 		}
+	}
 
-		return -1;
+	/* Maps Unicode code points to glyph indices. */
+	int glyph_id(uint_least32_t charCode, uint_fast32_t* glyph_id) const {
+		*glyph_id = 0;
+		if (bmp.empty())
+			return -1;
+		if (charCode <= 0xFFFF) {
+			if (bmp[charCode] == missing)
+				return -1;
+			*glyph_id = bmp[charCode];
+			return 0;
+		}
+		const auto found = std::upper_bound(ranges.begin(), ranges.end(), charCode, [](uint_least32_t code, const Range& range) { return code < range.firstCode; });
+		if (found != ranges.begin() && charCode <= (found - 1)->lastCode)
+			*glyph_id = (charCode - (found - 1)->firstCode) + (found - 1)->glyphOffset;
+		return 0;
 	}
 
-	int glyph_bbox(uint_fast32_t outline, int box[4]) const {
+	int glyph_bbox(uint_fast32_t outline, double size, int box[4]) const {
 		/* Read the bounding box from the font file verbatim. */
 		if (!is_safe_offset(outline, 10))
 			return -1;
@@ -703,8 +745,8 @@ struct Font {
 			return -1;
 
 		/* Transform the bounding box into SFT coordinate space. */
-		const double xscale = xScale / unitsPerEm;
-		const double yscale = yScale / unitsPerEm;
+		const double xscale = size / unitsPerEm;
+		const double yscale = size / unitsPerEm;
 		box[0] = (int)floor(box[0] * xscale + xOffset);
 		box[1] = (int)floor(box[1] * yscale + yOffset);
 		box[2] = (int)ceil(box[2] * xscale + xOffset);
@@ -712,26 +754,45 @@ struct Font {
 		return 0;
 	}
 
-	std::array<double, 6> glyph_transform(int* bbox) const {
+	std::array<double, 6> glyph_transform(int* bbox, double size) const {
 		/* Set up the transformation matrix such that
 		 * the transformed bounding boxes min corner segments
 		 * up with the (0, 0) point. */
 		std::array<double, 6> transform;
-		transform[0] = xScale / unitsPerEm;
+		transform[0] = size / unitsPerEm;
 		transform[1] = 0.0;
 		transform[2] = 0.0;
 		transform[4] = xOffset - bbox[0];
-		transform[3] = -yScale / unitsPerEm;
+		transform[3] = -size / unitsPerEm;
 		transform[5] = bbox[3] - yOffset;
 		return transform;
 	}
 };
 
 
-class Outline {
+struct Scratch { // Rasterizer buffers of one thread, reset between glyphs but never freed.
 	std::vector<Point> points;
 	std::vector<Curve> curves;
 	std::vector<Segment> segments;
+	std::vector<uint_fast16_t> endPts;
+	std::vector<uint8_t> flags;
+	std::vector<Cell> cells;
+	std::vector<uint8_t> coverage;
+	std::vector<uint8_t> padded;
+	std::vector<int> nearest;
+	bool outline = false; // An Outline holds points, curves, segments, endPts, flags and cells.
+};
+
+Scratch& scratch() {
+	thread_local Scratch scratch;
+	return scratch;
+}
+
+class Outline { // Lives in the given scratch, so only one at a time per scratch.
+	Scratch& scratch;
+	std::vector<Point>& points = scratch.points;
+	std::vector<Curve>& curves = scratch.curves;
+	std::vector<Segment>& segments = scratch.segments;
 
 	/* A heuristic to tell whether a given curve can be approximated closely enough by a line. */
 	int is_flat(const Curve& curve) const {
@@ -871,10 +932,10 @@ class Outline {
 			return -1;
 		points.resize(basePoint + numPts);
 
-		std::vector<uint_fast16_t> endPts;
+		auto& endPts = scratch.endPts;
 		endPts.resize(numContours);
 
-		std::vector<uint8_t> flags;
+		auto& flags = scratch.flags;
 		flags.resize(numPts);
 
 		for (unsigned i = 0; i < numContours; ++i) {
@@ -982,12 +1043,31 @@ class Outline {
 	}
 
 public:
-	Outline() {
-		points.reserve(64);
-		curves.reserve(64);
-		segments.reserve(64);
+	Outline(Scratch& scratch) : scratch(scratch) {
+		assert(!scratch.outline && "another Outline is live on this scratch");
+		scratch.outline = true;
+		points.clear();
+		curves.clear();
+		segments.clear();
+	}
+
+	Outline(Scratch& scratch, std::span<const Point> points, std::span<const Curve> curves, std::span<const Segment> segments) : scratch(scratch) {
+		assert(!scratch.outline && "another Outline is live on this scratch");
+		scratch.outline = true;
+		this->points.assign(points.begin(), points.end());
+		this->curves.assign(curves.begin(), curves.end());
+		this->segments.assign(segments.begin(), segments.end());
 	}
 
+	~Outline() { scratch.outline = false; }
+
+	Outline(const Outline&) = delete;
+	Outline& operator=(const Outline&) = delete;
+
+	const std::vector<Point>& get_points() const { return points; }
+	const std::vector<Curve>& get_curves() const { return curves; }
+	const std::vector<Segment>& get_segments() const { return segments; }
+
 	int decode_outline(const Font& font, uint_fast32_t offset, int recDepth) {
 		if (!font.is_safe_offset(offset, 10))
 			return -1;
@@ -1005,15 +1085,15 @@ public:
 		}
 	}
 
-	std::vector<uint8_t> render_outline(const double transform[6], unsigned width, unsigned height) {
+	void render_outline(const double transform[6], unsigned width, unsigned height, uint8_t* image) { // Leaves image untouched on failure.
 		transform_points((unsigned)points.size(), points.data(), transform);
 		clip_points((unsigned)points.size(), points.data(), width, height);
 
 		if (tesselate_curves() < 0)
-			return {};
+			return;
 
-		std::vector<Cell> cells;
-		cells.resize(width * height);
+		auto& cells = scratch.cells;
+		cells.assign((size_t)width * height, Cell());
 
 		Raster buf;
 		buf.cells = cells.data();
@@ -1021,84 +1101,504 @@ public:
 		buf.height = height;
 		draw_lines(buf);
 
-		std::vector<uint8_t> pixels;
-		pixels.resize(width * height);
-		post_process(buf, pixels.data());
+		post_process(buf, image);
+	}
+};
+
+
+class Outlines { // Decoded outlines by glyph id, in font units so every size can share them.
+public:
+	struct Entry {
+		uint_fast32_t offset = 0; // Of the outline in the font, 0 if it has none or failed to decode.
+		uint32_t point = 0;
+		uint32_t point_count = 0;
+		uint32_t curve = 0;
+		uint32_t curve_count = 0;
+		uint32_t segment = 0;
+		uint32_t segment_count = 0;
+	};
+
+private:
+	std::unordered_map<uint_fast32_t, Entry> entries; // Nodes don't move, so entries can be held while others are added.
+	std::vector<Point> points;
+	std::vector<Curve> curves;
+	std::vector<Segment> segments;
+
+public:
+	const Entry& decode(const Font& font, uint_fast32_t glyph_id) {
+		if (auto found = entries.find(glyph_id); found != entries.end())
+			return found->second;
+		auto& entry = entries[glyph_id];
+		if (uint_fast32_t offset = 0; font.outline_offset(glyph_id, &offset) == 0 && offset) {
+			Outline outl(scratch());
+			if (outl.decode_outline(font, offset, 0) == 0) {
+				entry.offset = offset;
+				entry.point = (uint32_t)points.size();
+				entry.point_count = (uint32_t)outl.get_points().size();
+				entry.curve = (uint32_t)curves.size();
+				entry.curve_count = (uint32_t)outl.get_curves().size();
+				entry.segment = (uint32_t)segments.size();
+				entry.segment_count = (uint32_t)outl.get_segments().size();
+				points.insert(points.end(), outl.get_points().begin(), outl.get_points().end());
+				curves.insert(curves.end(), outl.get_curves().begin(), outl.get_curves().end());
+				segments.insert(segments.end(), outl.get_segments().begin(), outl.get_segments().end());
+			}
+		}
+		return entry;
+	}
 
-		return pixels;
+	Outline make_outline(const Entry& entry, Scratch& scratch) const {
+		return Outline(scratch, std::span(points).subspan(entry.point, entry.point_count),
+			std::span(curves).subspan(entry.curve, entry.curve_count),
+			std::span(segments).subspan(entry.segment, entry.segment_count));
 	}
 };
 
 
-struct Glyph {
-	uint_fast32_t gid = 0;
+static inline constexpr double field_size = 64.0; // Font size distance fields are built at.
+static inline constexpr int field_spread = 8; // Field pixels kept around the outline.
+static inline constexpr float field_levels = 16.0f; // Distance steps per field pixel, 128 on the outline.
+
+/* Signed distance from each pixel center to the nearest coverage edge, positive inside. */
+static void distance_field(const uint8_t* coverage, int width, int height, uint8_t* distances) {
+	const auto inside = [&](int x, int y) { return coverage[y * width + x] > 127; };
+	auto& nearest = scratch().nearest; // Closest edge pixel found so far, or -1.
+	nearest.assign((size_t)width * height, -1);
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			const auto c = coverage[y * width + x];
+			if ((c > 0 && c < 255) ||
+				(x > 0 && inside(x - 1, y) != inside(x, y)) || (x + 1 < width && inside(x + 1, y) != inside(x, y)) ||
+				(y > 0 && inside(x, y - 1) != inside(x, y)) || (y + 1 < height && inside(x, y + 1) != inside(x, y)))
+				nearest[y * width + x] = y * width + x;
+		}
+	}
+
+	const auto length2 = [&](int index, int x, int y) {
+		const int dx = index % width - x;
+		const int dy = index / width - y;
+		return dx * dx + dy * dy;
+	};
+	const auto propagate = [&](int x, int y, int dx, int dy) { // Adopt the neighbour's edge if closer.
+		if (x + dx < 0 || y + dy < 0 || x + dx >= width || y + dy >= height)
+			return;
+		const int candidate = nearest[(y + dy) * width + x + dx];
+		auto& current = nearest[y * width + x];
+		if (candidate >= 0 && (current < 0 || length2(candidate, x, y) < length2(current, x, y)))
+			current = candidate;
+	};
+	for (int y = 0; y < height; ++y) { // Dead reckoning, down then up.
+		for (int x = 0; x < width; ++x) {
+			propagate(x, y, -1, -1); propagate(x, y, 0, -1); propagate(x, y, 1, -1); propagate(x, y, -1, 0);
+		}
+		for (int x = width - 1; x >= 0; --x) {
+			propagate(x, y, 1, 0);
+		}
+	}
+	for (int y = height - 1; y >= 0; --y) {
+		for (int x = width - 1; x >= 0; --x) {
+			propagate(x, y, 1, 1); propagate(x, y, 0, 1); propagate(x, y, -1, 1); propagate(x, y, 1, 0);
+		}
+		for (int x = 0; x < width; ++x) {
+			propagate(x, y, -1, 0);
+		}
+	}
+
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			const int edge = nearest[y * width + x];
+			float distance = inside(x, y) ? (float)field_spread : -(float)field_spread;
+			if (edge >= 0) { // The edge pixel's coverage places the outline within it.
+				const float offset = coverage[edge] / 255.0f - 0.5f;
+				const float length = sqrtf((float)length2(edge, x, y));
+				distance = inside(x, y) ? length + offset : offset - length;
+			}
+			distances[y * width + x] = (uint8_t)std::clamp(128.0f + distance * field_levels + 0.5f, 0.0f, 255.0f);
+		}
+	}
+}
+
+struct Field { // Distances around a glyph, sampled to draw it at any size.
+	std::span<const uint8_t> distances;
+	int width = 0;
+	int height = 0;
+	float u = 0.0f; // Field position of the center of glyph pixel (0, 0).
+	float v = 0.0f;
+	float step = 0.0f; // Field pixels per glyph pixel, 0 if no field.
+
+	TARGET_AVX2 int sample_row_avx2(const uint8_t* upper_row, const uint8_t* lower_row, float x, float fy, float factor, int i, int count, uint8_t* coverage) const { // Blocks of 8 whose taps are all in the rows, returns the pixels done.
+		const auto index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		const auto byte = _mm256_set1_epi32(0xff);
+		const auto zero = _mm256_setzero_ps();
+		const auto one = _mm256_set1_ps(1.0f);
+		const auto half = _mm256_set1_ps(0.5f);
+		for (; i + 8 <= count && (int)(x + (i + 7) * step) + 4 <= width; i += 8) { // Gathers read 4 bytes at each left tap.
+			const auto xs = _mm256_add_ps(_mm256_set1_ps(x), _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), index)), _mm256_set1_ps(step)));
+			const auto lefts = _mm256_cvttps_epi32(xs); // Floor, as x >= 0.
+			const auto fx = _mm256_sub_ps(xs, _mm256_cvtepi32_ps(lefts));
+			const auto upper_pairs = _mm256_i32gather_epi32((const int*)upper_row, lefts, 1);
+			const auto lower_pairs = _mm256_i32gather_epi32((const int*)lower_row, lefts, 1);
+			const auto upper_a = _mm256_cvtepi32_ps(_mm256_and_si256(upper_pairs, byte));
+			const auto upper_b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(upper_pairs, 8), byte));
+			const auto lower_a = _mm256_cvtepi32_ps(_mm256_and_si256(lower_pairs, byte));
+			const auto lower_b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(lower_pairs, 8), byte));
+			const auto upper = _mm256_add_ps(upper_a, _mm256_mul_ps(_mm256_sub_ps(upper_b, upper_a), fx));
+			const auto lower = _mm256_add_ps(lower_a, _mm256_mul_ps(_mm256_sub_ps(lower_b, lower_a), fx));
+			const auto distance = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(upper, _mm256_mul_ps(_mm256_sub_ps(lower, upper), _mm256_set1_ps(fy))), _mm256_set1_ps(128.0f)), _mm256_set1_ps(factor));
+			const auto values = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_add_ps(distance, half), zero), one), _mm256_set1_ps(255.0f)), half));
+			const auto words = _mm_packs_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+			_mm_storel_epi64((__m128i*)&coverage[i], _mm_packus_epi16(words, words));
+		}
+		_mm256_zeroupper();
+		return i;
+	}
+
+	void sample_row(float x, float y, int count, uint8_t* coverage) const { // Glyph pixels centered at field positions x + i * step, y.
+		const int top = (int)floorf(y);
+		const float fy = y - top;
+		const auto row = [&](int index) { return index >= 0 && index < height ? &distances[(size_t)index * width] : nullptr; };
+		const uint8_t* upper_row = row(top);
+		const uint8_t* lower_row = row(top + 1);
+		const auto at = [&](const uint8_t* values, int col) { return values && col >= 0 && col < width ? (float)values[col] : 0.0f; };
+		const float factor = 1.0f / (field_levels * step);
+		const auto sample = [&](int i) {
+			const float xi = x + i * step;
+			const int left = (int)floorf(xi);
+			const float fx = xi - left;
+			const float upper = at(upper_row, left) + (at(upper_row, left + 1) - at(upper_row, left)) * fx;
+			const float lower = at(lower_row, left) + (at(lower_row, left + 1) - at(lower_row, left)) * fx;
+			const float distance = (upper + (lower - upper) * fy - 128.0f) * factor; // In glyph pixels.
+			coverage[i] = (uint8_t)(std::clamp(distance + 0.5f, 0.0f, 1.0f) * 255.0f + 0.5f);
+		};
+		int i = 0;
+		if (upper_row && lower_row) { // Interior rows: past the left edge, all four taps exist.
+			for (; i < count && x + i * step < 0.0f; ++i) {
+				sample(i);
+			}
+			if (use_avx2)
+				i = sample_row_avx2(upper_row, lower_row, x, fy, factor, i, count, coverage);
+			const auto index = _mm_setr_epi32(0, 1, 2, 3);
+			const auto zero = _mm_setzero_ps();
+			const auto one = _mm_set1_ps(1.0f);
+			const auto half = _mm_set1_ps(0.5f);
+			for (; i + 4 <= count && (int)(x + (i + 3) * step) + 1 < width; i += 4) {
+				const auto xs = _mm_add_ps(_mm_set1_ps(x), _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), index)), _mm_set1_ps(step)));
+				const auto lefts = _mm_cvttps_epi32(xs); // Floor, as x >= 0.
+				const auto fx = _mm_sub_ps(xs, _mm_cvtepi32_ps(lefts));
+				alignas(16) int32_t l[4];
+				_mm_store_si128((__m128i*)l, lefts);
+				const auto lerp = [&](const uint8_t* values) {
+					const auto a = _mm_setr_ps(values[l[0]], values[l[1]], values[l[2]], values[l[3]]);
+					const auto b = _mm_setr_ps(values[l[0] + 1], values[l[1] + 1], values[l[2] + 1], values[l[3] + 1]);
+					return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fx));
+				};
+				const auto upper = lerp(upper_row);
+				const auto lower = lerp(lower_row);
+				const auto distance = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(upper, _mm_mul_ps(_mm_sub_ps(lower, upper), _mm_set1_ps(fy))), _mm_set1_ps(128.0f)), _mm_set1_ps(factor));
+				const auto values = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_add_ps(distance, half), zero), one), _mm_set1_ps(255.0f)), half));
+				const auto words = _mm_packs_epi32(values, values);
+				const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+				memcpy(&coverage[i], &bytes, sizeof(bytes));
+			}
+		}
+		for (; i < count; ++i) {
+			sample(i);
+		}
+	}
+};
+
+struct Glyph { // Views into the Book atlas, valid until the next glyph is added.
 	Metrics mtx;
-	std::vector<uint8_t> pixels;
+	std::span<const uint8_t> pixels; // Coverage, unless drawn from field.
+	Field field;
 };
 
+static inline constexpr unsigned direct_glyph_count = 145;
+
+int direct_glyph(uint32_t codepoint) { // ASCII and the symbols the editor draws skip the hash map.
+	if (codepoint < 128)
+		return (int)codepoint;
+	switch (codepoint) {
+	case Codepoint::SPACE: return 128;
+	case Codepoint::TAB: return 129;
+	case Codepoint::CARRIAGE: return 130;
+	case Codepoint::RETURN: return 131;
+	case Codepoint::BOTTOM: return 132;
+	case Codepoint::BLOCK: return 133;
+	case Codepoint::LINE: return 134;
+	case 8304: return 135; // Superscript digits.
+	case 185: return 136;
+	case 178: return 137;
+	case 179: return 138;
+	case 8308: case 8309: case 8310: case 8311: case 8312: case 8313: return 139 + (int)(codepoint - 8308);
+	}
+	return -1;
+}
+
 class Book {
-	Font font;
+	Font font; // Line metrics at the current size. Glyphs pass their own size, so fields share the tables.
+	Outlines outlines;
+
+	struct Slot {
+		Metrics mtx;
+		size_t offset = 0; // Into atlas, minWidth * minHeight bytes plus padding.
+	};
+
+	struct Glyphs { // Rasterized at one font size.
+		double size = 0.0;
+		int padding = 0; // Around each glyph, holding distances instead of coverage when set.
+		std::vector<uint8_t> atlas; // Coverage or distances of all glyphs, back to back.
+		std::vector<Slot> slots;
+		std::array<uint32_t, direct_glyph_count> direct = {}; // Slot + 1, or 0 if not added yet.
+		std::unordered_map<uint32_t, uint32_t> others;
+
+		int reach_left = 0; // Pixels covered by any glyph, relative to its cell origin.
+		int reach_right = 0;
+
+		size_t memory() const { return atlas.capacity() + slots.capacity() * sizeof(Slot) + others.size() * 4 * sizeof(uint32_t); }
+	};
+
+	Glyphs glyphs; // At the current size.
+	std::deque<Glyphs> recent; // Other sizes, most recently used first, so zooming back is free.
+
+	Glyphs fields = { field_size, field_spread }; // Built once, then sampled at every size, so zooming is free.
+	bool use_fields = false;
+
+	static inline constexpr size_t recent_budget = 64 * MB;
+
+	void trim_recent() {
+		size_t memory = 0;
+		for (size_t i = 0; i < recent.size(); ++i) {
+			memory += recent[i].memory();
+			if (memory > recent_budget) {
+				recent.resize(i);
+				break;
+			}
+		}
+	}
 
-	std::unordered_map<uint32_t, Glyph> glyphs;
+	void switch_glyphs(double size) {
+		if (!glyphs.slots.empty())
+			recent.push_front(std::move(glyphs));
+		glyphs = Glyphs();
+		glyphs.size = size;
+		for (auto it = recent.begin(); it != recent.end(); ++it) {
+			if (it->size == size) {
+				glyphs = std::move(*it);
+				recent.erase(it);
+				break;
+			}
+		}
+		trim_recent();
+	}
 
-	Metrics get_metrics(const uint_fast32_t glyph_id) const {
-		return font.get_metrics(glyph_id);
+	void load_glyphs() { // For the current size.
+		if (glyphs.size != font.get_size())
+			switch_glyphs(font.get_size());
+		if (glyphs.slots.empty())
+			prewarm(glyphs);
 	}
 
-	std::vector<uint8_t> render(uint_fast32_t glyph_id, const Metrics& metrics) const {
-		uint_fast32_t outline;
-		if (font.outline_offset(glyph_id, &outline) < 0)
-			return {};
-		if (!outline)
-			return {};
+	double get_scale() const { return font.get_size() / field_size; } // Pixels per field pixel.
+
+	struct Pending {
+		Metrics mtx;
+		const Outlines::Entry* outline = nullptr;
+		bool valid = false;
+	};
+
+	Pending prepare(double size, uint32_t codepoint) { // Lookups that fill the shared outline cache.
+		Pending pending;
+		if (uint_fast32_t gid = 0; font.glyph_id(codepoint, &gid) == 0) {
+			pending.mtx = font.get_metrics(gid, size);
+			if (pending.mtx.is_valid()) {
+				pending.outline = &outlines.decode(font, gid);
+				pending.valid = true;
+			}
+		}
+		return pending;
+	}
 
-		Outline outl;
-		if (outl.decode_outline(font, outline, 0) < 0)
-			return {};
+	void render(double size, const Pending& pending, uint8_t* image) const { // Only reads, so safe from several threads once prepared.
+		if (!pending.outline->offset)
+			return;
 
 		int bbox[4];
-		if (font.glyph_bbox(outline, bbox) < 0)
-			return {};
+		if (font.glyph_bbox(pending.outline->offset, size, bbox) < 0)
+			return;
 
-		const auto transform = font.glyph_transform(bbox);
-		return outl.render_outline(transform.data(), metrics.minWidth, metrics.minHeight);
+		const auto transform = font.glyph_transform(bbox, size);
+		outlines.make_outline(*pending.outline, scratch()).render_outline(transform.data(), pending.mtx.minWidth, pending.mtx.minHeight, image);
 	}
 
-	const Glyph& add_glyph(uint32_t codepoint) {
-		auto& glyph = glyphs[codepoint];
-		if (font.glyph_id(codepoint, &glyph.gid) == 0) {
-			glyph.mtx = get_metrics(glyph.gid);
-			if (glyph.mtx.is_valid()) {
-				glyph.pixels = render(glyph.gid, glyph.mtx);
-				return glyph;
-			}
+	void fill(const Glyphs& set, const Pending& pending, uint8_t* image) const { // Coverage, or distances around it.
+		if (!set.padding)
+			return render(set.size, pending, image);
+
+		const int width = pending.mtx.minWidth;
+		const int height = pending.mtx.minHeight;
+		auto& coverage = scratch().coverage;
+		coverage.assign((size_t)width * height, 0);
+		render(set.size, pending, coverage.data());
+
+		const int pitch = width + 2 * set.padding;
+		auto& padded = scratch().padded;
+		padded.assign((size_t)pitch * (height + 2 * set.padding), 0);
+		for (int y = 0; y < height; ++y) {
+			memcpy(&padded[(size_t)(y + set.padding) * pitch + set.padding], &coverage[(size_t)y * width], width);
+		}
+		distance_field(padded.data(), pitch, height + 2 * set.padding, image);
+	}
+
+	uint32_t add_slot(Glyphs& set, uint32_t codepoint, const Pending& pending) { // Blank until filled.
+		if (pending.valid) {
+			const auto& mtx = pending.mtx;
+			const auto offset = set.atlas.size();
+			set.atlas.resize(offset + (size_t)(mtx.minWidth + 2 * set.padding) * (size_t)(mtx.minHeight + 2 * set.padding));
+			set.slots.push_back({ mtx, offset });
+			set.reach_left = std::min(set.reach_left, (int)mtx.leftSideBearing);
+			set.reach_right = std::max(set.reach_right, (int)mtx.leftSideBearing + mtx.minWidth);
+			return (uint32_t)set.slots.size() - 1;
+		}
+		if (codepoint != 0)
+			return find_slot(set, 0);
+		set.slots.push_back({});
+		return (uint32_t)set.slots.size() - 1;
+	}
+
+	uint32_t add_glyph(Glyphs& set, uint32_t codepoint) {
+		const auto pending = prepare(set.size, codepoint);
+		const auto slot = add_slot(set, codepoint, pending);
+		if (pending.valid)
+			fill(set, pending, set.atlas.data() + set.slots[slot].offset);
+		return slot;
+	}
+
+	void prewarm(Glyphs& set) { // What every frame draws, rasterized in parallel.
+		std::vector<uint32_t> codepoints = { 0, Codepoint::SPACE, Codepoint::TAB, Codepoint::CARRIAGE, Codepoint::RETURN, Codepoint::BOTTOM, Codepoint::LINE };
+		for (uint32_t c = 32; c < 127; ++c) {
+			codepoints.push_back(c);
+		}
+		for (unsigned i = 0; i < 10; ++i) {
+			codepoints.push_back(superscript_codepoint(i));
+		}
+		std::vector<Pending> pendings;
+		for (auto codepoint : codepoints) { // Glyph 0 first, it is the fallback.
+			pendings.push_back(prepare(set.size, codepoint));
+			set.direct[direct_glyph(codepoint)] = add_slot(set, codepoint, pendings.back()) + 1;
+		}
+		workers().parallel_for((unsigned)codepoints.size(), [&](unsigned index) { // The atlas doesn't grow meanwhile.
+			if (pendings[index].valid)
+				fill(set, pendings[index], set.atlas.data() + set.slots[set.direct[direct_glyph(codepoints[index])] - 1].offset);
+		});
+	}
+
+	uint32_t find_slot(Glyphs& set, uint32_t codepoint) {
+		if (const auto index = direct_glyph(codepoint); index >= 0) {
+			if (set.direct[index] == 0)
+				set.direct[index] = add_glyph(set, codepoint) + 1;
+			return set.direct[index] - 1;
 		}
-		return add_glyph(0);
+		if (auto found = set.others.find(codepoint); found != set.others.end())
+			return found->second;
+		const auto slot = add_glyph(set, codepoint);
+		set.others[codepoint] = slot;
+		return slot;
+	}
+
+	static uint32_t get_slot(const Glyphs& set, uint32_t codepoint) { // Slot of a glyph already found, or of glyph 0.
+		if (const auto index = direct_glyph(codepoint); index >= 0) {
+			if (set.direct[index] != 0)
+				return set.direct[index] - 1;
+		}
+		else if (auto found = set.others.find(codepoint); found != set.others.end()) {
+			return found->second;
+		}
+		return set.direct[0] - 1;
+	}
+
+	Glyph make_glyph(uint32_t slot) const {
+		const auto& mtx = glyphs.slots[slot].mtx;
+		return { mtx, { glyphs.atlas.data() + glyphs.slots[slot].offset, (size_t)mtx.minWidth * (size_t)mtx.minHeight } };
+	}
+
+	Glyph make_field(uint32_t slot) const { // Box and sample positions at the current size.
+		const auto& ref = fields.slots[slot].mtx;
+		const double scale = get_scale();
+		Glyph glyph;
+		glyph.mtx.advanceWidth = ref.advanceWidth * scale;
+		glyph.mtx.leftSideBearing = ref.leftSideBearing * scale;
+		if (ref.minWidth == 0)
+			return glyph;
+
+		const int left = (int)ref.leftSideBearing;
+		const int top = ref.yOffset;
+		const int x = (int)floor(left * scale);
+		const int y = (int)floor(top * scale);
+		glyph.mtx.leftSideBearing = x;
+		glyph.mtx.yOffset = y;
+		glyph.mtx.minWidth = (int)ceil((left + ref.minWidth) * scale) - x;
+		glyph.mtx.minHeight = (int)ceil((top + ref.minHeight) * scale) - y;
+
+		glyph.field.width = ref.minWidth + 2 * fields.padding;
+		glyph.field.height = ref.minHeight + 2 * fields.padding;
+		glyph.field.distances = { fields.atlas.data() + fields.slots[slot].offset, (size_t)glyph.field.width * (size_t)glyph.field.height };
+		glyph.field.step = (float)(1.0 / scale);
+		glyph.field.u = (float)((x + 0.5) / scale - left + fields.padding - 0.5);
+		glyph.field.v = (float)((y + 0.5) / scale - top + fields.padding - 0.5);
+		return glyph;
 	}
 
 public:
 	Book(const std::string_view path)
-		: font(path)
-	{}
+		: font(path) {
+	}
 
-	void clear() {
-		glyphs.clear();
+	Glyph find_glyph(uint32_t codepoint) {
+		if (use_fields)
+			return make_field(find_slot(fields, codepoint));
+		return make_glyph(find_slot(glyphs, codepoint));
 	}
 
-	const Glyph& find_glyph(uint32_t codepoint) {
-		if (auto found = glyphs.find(codepoint); found != glyphs.end())
-			return found->second;
-		return add_glyph(codepoint);
+	Glyph get_glyph(uint32_t codepoint) const { // Const lookup of a glyph already found, or glyph 0.
+		if (use_fields)
+			return make_field(get_slot(fields, codepoint));
+		return make_glyph(get_slot(glyphs, codepoint));
 	}
 
-	void set_font_size(double size) {
+	bool set_font_size(double size) {
 		if (font.set_size(size)) {
-			clear();
-			add_glyph(0);
+			if (!use_fields)
+				load_glyphs();
+			return true;
 		}
+		return false;
+	}
+
+	bool set_fields(bool enabled) { // Sample distance fields instead of rasterizing each size.
+		if (enabled == use_fields)
+			return false;
+		use_fields = enabled;
+		if (!use_fields)
+			load_glyphs();
+		else if (fields.slots.empty())
+			prewarm(fields);
+		return true;
 	}
 
-	unsigned get_character_width() const { return (unsigned)glyphs.find(0)->second.mtx.advanceWidth; }
+	bool get_fields() const { return use_fields; }
+
+	unsigned get_character_width() const {
+		if (use_fields)
+			return (unsigned)(fields.slots[fields.direct[0] - 1].mtx.advanceWidth * get_scale());
+		return (unsigned)glyphs.slots[glyphs.direct[0] - 1].mtx.advanceWidth;
+	}
 	unsigned get_line_height() const { return font.get_line_height(); }
+	unsigned get_overhang() const { // How far glyphs so far reach past their cell.
+		if (use_fields)
+			return (unsigned)std::max({ (int)ceil(-fields.reach_left * get_scale()), (int)ceil(fields.reach_right * get_scale()) - (int)get_character_width(), 0 });
+		return (unsigned)std::max(-glyphs.reach_left, glyphs.reach_right - (int)get_character_width());
+	}
 	unsigned get_line_baseline() const { return font.get_line_baseline(); }
 };
+
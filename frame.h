@@ -0,0 +1,368 @@
+#pragma once
+
+int pack_color(const Color color) { // From the fields: reading a Color through as_uint() breaks strict aliasing once inlined.
+	return (int)((uint32_t)color.b | (uint32_t)color.g << 8 | (uint32_t)color.r << 16 | (uint32_t)color.a << 24);
+}
+
+TARGET_AVX2 int blend_row_avx2(Color* out, const uint8_t* in, int count, const Color color) { // Whole blocks of 8, returns the pixels done.
+	int i = 0;
+	const auto zero = _mm256_setzero_si256();
+	const auto full = _mm256_set1_epi16(255);
+	const auto mask = _mm256_set1_epi32((int)0xff000000);
+	const auto src = _mm256_unpacklo_epi8(_mm256_set1_epi32(pack_color(color)), zero);
+	for (; i + 8 <= count; i += 8) {
+		const auto dst = _mm256_loadu_si256((const __m256i*)&out[i]);
+		const auto bytes = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&in[i]), _mm_loadl_epi64((const __m128i*)&in[i]));
+		const auto alpha = _mm256_set_m128i(_mm_unpackhi_epi16(bytes, bytes), _mm_unpacklo_epi16(bytes, bytes));
+		const auto a_lo = _mm256_unpacklo_epi8(alpha, zero);
+		const auto a_hi = _mm256_unpackhi_epi8(alpha, zero);
+		const auto lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(dst, zero), _mm256_sub_epi16(full, a_lo)), _mm256_mullo_epi16(src, a_lo)), 8);
+		const auto hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(dst, zero), _mm256_sub_epi16(full, a_hi)), _mm256_mullo_epi16(src, a_hi)), 8);
+		_mm256_storeu_si256((__m256i*)&out[i], _mm256_or_si256(_mm256_and_si256(mask, dst), _mm256_andnot_si256(mask, _mm256_packus_epi16(lo, hi))));
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+void blend_row(Color* out, const uint8_t* in, int count, const Color color) { // Same as Color::blend per pixel, alpha kept.
+	int i = 0;
+	if (use_avx2)
+		i = blend_row_avx2(out, in, count, color);
+	const auto zero = _mm_setzero_si128();
+	const auto full = _mm_set1_epi16(255);
+	const auto mask = _mm_set1_epi32((int)0xff000000);
+	const auto src = _mm_unpacklo_epi8(_mm_set1_epi32(pack_color(color)), zero);
+	for (; i + 4 <= count; i += 4) {
+		const auto dst = _mm_loadu_si128((const __m128i*)&out[i]);
+		int coverage;
+		memcpy(&coverage, &in[i], sizeof(coverage));
+		const auto bytes = _mm_unpacklo_epi8(_mm_cvtsi32_si128(coverage), _mm_cvtsi32_si128(coverage));
+		const auto alpha = _mm_unpacklo_epi16(bytes, bytes);
+		const auto a_lo = _mm_unpacklo_epi8(alpha, zero);
+		const auto a_hi = _mm_unpackhi_epi8(alpha, zero);
+		const auto lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), _mm_sub_epi16(full, a_lo)), _mm_mullo_epi16(src, a_lo)), 8);
+		const auto hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), _mm_sub_epi16(full, a_hi)), _mm_mullo_epi16(src, a_hi)), 8);
+		_mm_storeu_si128((__m128i*)&out[i], _mm_or_si128(_mm_and_si128(mask, dst), _mm_andnot_si128(mask, _mm_packus_epi16(lo, hi))));
+	}
+	auto c = color;
+	for (; i < count; ++i) {
+		out[i].blend(c.set_alpha(in[i]));
+	}
+}
+
+TARGET_AVX2 int fill_row_avx2(Color* out, int count, const Color color) {
+	int i = 0;
+	const auto value = _mm256_set1_epi32(pack_color(color));
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_si256((__m256i*)&out[i], value);
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+void fill_row(Color* out, int count, const Color color) {
+	int i = 0;
+	if (use_avx2)
+		i = fill_row_avx2(out, count, color);
+	const auto value = _mm_set1_epi32(pack_color(color));
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_si128((__m128i*)&out[i], value);
+	}
+	for (; i < count; ++i) {
+		out[i] = color;
+	}
+}
+
+struct Rect {
+	unsigned left = 0;
+	unsigned top = 0;
+	unsigned right = 0;
+	unsigned bottom = 0;
+};
+
+class Frame { // Offscreen render target with the same surface as Window, for headless runs.
+	std::vector<Color> pixels;
+
+	unsigned width = 0;
+	unsigned height = 0;
+
+	size_t presented = 0; // Pixels, to measure what blits would send.
+
+public:
+	void resize(unsigned width, unsigned height) {
+		this->width = width;
+		this->height = height;
+		pixels.assign((size_t)width * height, Color());
+	}
+
+	void clear(uint32_t color) {
+		memset(pixels.data(), color, pixels.size() * sizeof(Color));
+	}
+
+	void clear(uint32_t color, unsigned top, unsigned bottom) { // Rows [top, bottom) only.
+		bottom = std::min(bottom, height);
+		if (top < bottom)
+			memset(pixels.data() + (size_t)top * width, color, (size_t)(bottom - top) * width * sizeof(Color));
+	}
+
+	void blit() {
+		presented += pixels.size();
+	}
+
+	void blit(const std::vector<Rect>& rects) {
+		for (auto& rect : rects) {
+			presented += (size_t)(rect.right - rect.left) * (rect.bottom - rect.top);
+		}
+	}
+
+	size_t get_presented() const { return presented; }
+
+	bool dump(const std::string& filename) const { // Binary PPM, easy to diff or convert.
+		std::ofstream out(filename, std::ios::binary);
+		out << "P6\n" << width << " " << height << "\n255\n";
+		std::vector<uint8_t> rgb;
+		rgb.reserve(pixels.size() * 3);
+		for (auto& pixel : pixels) {
+			rgb.push_back(pixel.r);
+			rgb.push_back(pixel.g);
+			rgb.push_back(pixel.b);
+		}
+		out.write((const char*)rgb.data(), rgb.size());
+		return out.good();
+	}
+
+	size_t count_different(const Frame& other) const { // Pixels whose color differs, alpha ignored.
+		if (width != other.width || height != other.height)
+			return std::max(pixels.size(), other.pixels.size());
+		size_t count = 0;
+		for (size_t i = 0; i < pixels.size(); ++i) {
+			const auto& a = pixels[i];
+			const auto& b = other.pixels[i];
+			count += a.r != b.r || a.g != b.g || a.b != b.b;
+		}
+		return count;
+	}
+
+	Color* get_pixels() { return pixels.data(); }
+	unsigned get_width() const { return width; }
+	unsigned get_height() const { return height; }
+};
+
+class Renderer { // Draws characters into a Window or a Frame.
+	static inline constexpr unsigned gutter_cols = 7; // Line number and indicator before the text.
+
+	std::vector<Characters> rows; // Last frame by row, to only redraw damaged cells.
+
+	bool present_all = true;
+
+	void render_character(Color* pixels, unsigned width, const Rect& clip, const Book& book, const Character& character) const {
+		const auto glyph = book.get_glyph(character.index);
+		const int x = (int)(character.col * book.get_character_width()) + (int)glyph.mtx.leftSideBearing;
+		const int y = (int)book.get_line_baseline() + (int)clip.top + glyph.mtx.yOffset;
+		const int left = std::max(0, (int)clip.left - x);
+		const int right = std::min(glyph.mtx.minWidth, (int)clip.right - x);
+		for (int j = std::max(0, (int)clip.top - y); j < glyph.mtx.minHeight && y + j < (int)clip.bottom && left < right; ++j) {
+			if (glyph.field.step > 0.0f)
+				render_field_row(&pixels[(y + j) * (int)width + x + left], glyph.field, left, right, j, character.color);
+			else
+				blend_row(&pixels[(y + j) * (int)width + x + left], &glyph.pixels[j * glyph.mtx.minWidth + left], right - left, character.color);
+		}
+	}
+
+	static void render_field_row(Color* out, const Field& field, int left, int right, int row, const Color color) { // Glyph pixels [left, right) of row, sampled in chunks.
+		std::array<uint8_t, 64> coverage;
+		const float v = field.v + row * field.step;
+		for (int i = left; i < right; i += (int)coverage.size()) {
+			const int count = std::min(right - i, (int)coverage.size());
+			field.sample_row(field.u + i * field.step, v, count, coverage.data());
+			blend_row(out + (i - left), coverage.data(), count, color);
+		}
+	}
+
+	void render_cells(Color* pixels, unsigned width, const Rect& clip, const Book& book, const Character& character, unsigned count) const { // Solid fill of count cells, no glyph.
+		const unsigned left = std::clamp(character.col * book.get_character_width(), clip.left, clip.right);
+		const unsigned right = std::clamp((character.col + count) * book.get_character_width(), left, clip.right);
+		for (unsigned y = clip.top; y < clip.bottom; ++y) {
+			fill_row(&pixels[y * width + left], (int)(right - left), character.color);
+		}
+	}
+
+	void render_row(Color* pixels, unsigned width, const Rect& clip, const Book& book, const Characters& characters) const { // Clip is within the row band. Runs of BLOCK cells become one span.
+		for (unsigned y = clip.top; y < clip.bottom; ++y) {
+			fill_row(&pixels[y * width + clip.left], (int)(clip.right - clip.left), colors().clear);
+		}
+		for (size_t i = 0; i < characters.size();) {
+			const auto& character = characters[i];
+			if (character.index == Codepoint::BLOCK) {
+				unsigned count = 1;
+				while (i + count < characters.size() && characters[i + count].index == Codepoint::BLOCK &&
+					characters[i + count].color == character.color && characters[i + count].col == character.col + count)
+					count++;
+				render_cells(pixels, width, clip, book, character, count);
+				i += count;
+			}
+			else {
+				render_character(pixels, width, clip, book, character);
+				i++;
+			}
+		}
+	}
+
+	static bool same_cell(const Character& a, const Character& b) {
+		return a.index == b.index && a.color == b.color && a.col == b.col;
+	}
+
+	static bool same_cells(const Characters& a, const Characters& b) { // Ignoring rows, as drawing is clipped to the row band.
+		return std::equal(a.begin(), a.end(), b.begin(), b.end(), same_cell);
+	}
+
+	static std::pair<unsigned, unsigned> find_damage(Characters a, Characters b) { // Columns [first, last] whose cells differ.
+		const auto by_col = [](const Character& x, const Character& y) { return x.col < y.col; };
+		std::stable_sort(a.begin(), a.end(), by_col);
+		std::stable_sort(b.begin(), b.end(), by_col);
+		unsigned first = UINT_MAX, last = 0;
+		for (size_t i = 0, j = 0; i < a.size() || j < b.size();) {
+			const auto col = std::min(i < a.size() ? a[i].col : UINT_MAX, j < b.size() ? b[j].col : UINT_MAX);
+			size_t i_end = i, j_end = j;
+			while (i_end < a.size() && a[i_end].col == col) i_end++;
+			while (j_end < b.size() && b[j_end].col == col) j_end++;
+			if (!std::equal(a.begin() + i, a.begin() + i_end, b.begin() + j, b.begin() + j_end, same_cell)) {
+				first = std::min(first, col);
+				last = std::max(last, col);
+			}
+			i = i_end;
+			j = j_end;
+		}
+		return { first, last };
+	}
+
+	static bool same_text(const Characters& a, const Characters& b) { // Ignoring the gutter, whose line numbers are relative to the cursor.
+		const auto text = [](const Character& character) { return character.col >= gutter_cols; };
+		auto i = std::find_if(a.begin(), a.end(), text);
+		auto j = std::find_if(b.begin(), b.end(), text);
+		for (; i != a.end() && j != b.end(); i = std::find_if(i + 1, a.end(), text), j = std::find_if(j + 1, b.end(), text)) {
+			if (!same_cell(*i, *j))
+				return false;
+		}
+		return i == a.end() && j == b.end();
+	}
+
+	unsigned count_same(const std::vector<Characters>& next, int shift) const {
+		unsigned count = 0;
+		for (int row = std::max(0, -shift); row < (int)next.size() && row + shift < (int)rows.size(); ++row) {
+			count += same_text(next[row], rows[row + shift]) ? 1 : 0;
+		}
+		return count;
+	}
+
+	template <typename T>
+	void scroll(T& target, const Book& book, int shift, std::vector<Rect>& rects) { // Moves kept rows into place and blanks exposed ones, only as far right as the rows have cells.
+		const unsigned width = target.get_width();
+		const unsigned line_height = book.get_line_height();
+		std::vector<unsigned> reach(rows.size()); // Pixels from the left edge that can differ from the clear color.
+		for (size_t row = 0; row < rows.size(); ++row) {
+			unsigned cols = 0;
+			for (const auto& character : rows[row]) {
+				cols = std::max(cols, character.col + 1);
+			}
+			reach[row] = std::min(cols * book.get_character_width() + book.get_overhang(), width);
+		}
+		const auto band = [&](int row, unsigned right) {
+			Rect rect;
+			rect.right = right;
+			rect.top = row * line_height;
+			rect.bottom = (row + 1) * line_height;
+			rects.push_back(rect);
+			return target.get_pixels() + (size_t)row * line_height * width;
+		};
+		const int count = (int)rows.size() - std::abs(shift);
+		for (int i = 0; i < count; ++i) { // In the order that reads each band before it is overwritten.
+			const int to = shift > 0 ? i : (int)rows.size() - 1 - i;
+			const int from = to + shift;
+			const auto span = std::max(reach[from], reach[to]);
+			auto* out = band(to, span);
+			for (unsigned y = 0; y < line_height; ++y) {
+				memcpy(out + (size_t)y * width, target.get_pixels() + ((size_t)from * line_height + y) * width, span * sizeof(Color));
+			}
+		}
+		const int exposed = shift > 0 ? count : 0;
+		for (int row = exposed; row < exposed + std::abs(shift); ++row) {
+			auto* out = band(row, reach[row]);
+			for (unsigned y = 0; y < line_height; ++y) {
+				fill_row(out + (size_t)y * width, (int)reach[row], colors().clear);
+			}
+		}
+		if (shift > 0) std::move(rows.begin() + shift, rows.end(), rows.begin());
+		else std::move_backward(rows.begin(), rows.begin() + count, rows.end());
+		for (int row = exposed; row < exposed + std::abs(shift); ++row) {
+			rows[row].clear();
+		}
+	}
+
+public:
+	void reset() {
+		rows.clear();
+	}
+
+	void invalidate() { // The screen lost its copy, so present the whole next frame.
+		present_all = true;
+	}
+
+	template <typename T>
+	void render(T& target, Book& book, const Characters& characters, unsigned col_count, unsigned row_count, int shift) { // Shift is a hint of how many rows the text scrolled up.
+		if (auto* pixels = target.get_pixels()) {
+			const auto width = target.get_width();
+			const auto height = target.get_height();
+			const auto line_height = book.get_line_height();
+			std::vector<Characters> next(row_count);
+			for (auto& character : characters) {
+				if (character.col < col_count && character.row < row_count)
+					next[character.row].push_back(character);
+			}
+			std::vector<Rect> moved; // Pixels scrolled into place, presented along with the damage.
+			if (rows.size() != next.size()) { // Size or font changed, nothing to keep.
+				target.clear((uint32_t)pack_color(colors().clear));
+				rows.assign(next.size(), {});
+				present_all = true;
+			}
+			else if (shift != 0 && std::abs(shift) < (int)next.size() && count_same(next, shift) > count_same(next, 0)) { // Moved rows then only redraw their gutter.
+				scroll(target, book, shift, moved);
+			}
+			std::vector<unsigned> damaged;
+			for (unsigned row = 0; row < row_count; ++row) {
+				if (!same_cells(next[row], rows[row])) {
+					damaged.push_back(row);
+					for (auto& character : next[row]) {
+						if (character.index != Codepoint::BLOCK)
+							book.find_glyph(character.index); // Workers can only read the atlas.
+					}
+				}
+			}
+			std::vector<Rect> rects; // Changed cells, widened by how far glyphs reach into their neighbours.
+			const auto overhang = book.get_overhang();
+			for (auto row : damaged) {
+				auto [first, last] = find_damage(rows[row], next[row]);
+				if (first > last) { first = 0; last = col_count; } // Same cells drawn in another order.
+				Rect rect;
+				rect.left = std::min(first * book.get_character_width() - std::min(first * book.get_character_width(), overhang), width);
+				rect.right = std::min((last + 1) * book.get_character_width() + overhang, width);
+				rect.top = row * line_height;
+				rect.bottom = std::min((row + 1) * line_height, height);
+				rects.push_back(rect);
+			}
+			workers().parallel_for((unsigned)damaged.size(), [&](unsigned index) { // Each row only touches its own band.
+				render_row(pixels, width, rects[index], book, next[damaged[index]]);
+			});
+			rows = std::move(next);
+			rects.insert(rects.end(), moved.begin(), moved.end());
+			if (present_all) {
+				target.blit();
+				present_all = false;
+			}
+			else if (!rects.empty()) {
+				target.blit(rects);
+			}
+		}
+	}
+};
+
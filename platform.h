@@ -0,0 +1,179 @@
+#pragma once
+
+#if defined(_MSC_VER)
+#define TARGET_AVX2 // MSVC emits AVX2 intrinsics in any function.
+#else
+#define TARGET_AVX2 __attribute__((target("avx2"))) // Only the AVX2 kernels, so the rest still runs without it.
+#endif
+
+bool has_avx2() {
+#if defined(_MSC_VER)
+	int info[4] = {};
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) // OSXSAVE and AVX.
+		return false;
+	if ((_xgetbv(0) & 6) != 6) // YMM state saved by the OS.
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2"); // Checks the OS saves YMM state too.
+#endif
+}
+
+static inline bool use_avx2 = has_avx2(); // Cleared by the bench to time the SSE2 paths.
+
+#if !defined(_WIN32) // POSIX stand-ins for the Win32 file calls made by the shared headers, so the bench builds elsewhere.
+
+typedef int BOOL;
+typedef uint32_t DWORD;
+typedef void* HANDLE;
+typedef const char* LPCSTR;
+
+struct LARGE_INTEGER { long long QuadPart; };
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define GENERIC_READ 0x80000000u
+#define GENERIC_WRITE 0x40000000u
+#define FILE_SHARE_READ 0x1
+#define FILE_SHARE_WRITE 0x2
+#define FILE_SHARE_DELETE 0x4
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define TRUNCATE_EXISTING 5
+#define FILE_ATTRIBUTE_READONLY 0x1
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define PAGE_READONLY 0x2
+#define FILE_MAP_READ 0x4
+#define MOVEFILE_REPLACE_EXISTING 0x1
+#define ERROR_SHARING_VIOLATION 32 // Never raised: POSIX has no share modes.
+
+struct PosixHandle { // File, mapping or directory search.
+	int fd = -1;
+	DIR* dir = nullptr;
+	std::string path;
+};
+
+struct WIN32_FIND_DATA {
+	DWORD dwFileAttributes = 0;
+	char cFileName[256] = {};
+};
+
+struct Views { // munmap needs the length MapViewOfFile chose.
+	std::mutex mutex;
+	std::unordered_map<const void*, size_t> sizes;
+};
+
+Views& views() {
+	static Views views;
+	return views;
+}
+
+DWORD GetLastError() { return (DWORD)errno; }
+
+BOOL CloseHandle(HANDLE handle) {
+	if (handle == nullptr || handle == INVALID_HANDLE_VALUE)
+		return false;
+	const auto posix = (PosixHandle*)handle;
+	if (posix->fd >= 0)
+		close(posix->fd);
+	if (posix->dir)
+		closedir(posix->dir);
+	delete posix;
+	return true;
+}
+
+HANDLE CreateFileA(LPCSTR filename, DWORD access, DWORD, void*, DWORD disposition, DWORD, HANDLE) {
+	int flags = (access & GENERIC_WRITE) ? O_WRONLY : O_RDONLY;
+	if (disposition == CREATE_ALWAYS) flags |= O_CREAT | O_TRUNC;
+	else if (disposition == TRUNCATE_EXISTING) flags |= O_TRUNC;
+	const int fd = open(filename, flags | O_CLOEXEC, 0644);
+	return fd < 0 ? INVALID_HANDLE_VALUE : new PosixHandle{ fd };
+}
+
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* size) {
+	struct stat st;
+	if (fstat(((PosixHandle*)file)->fd, &st) != 0)
+		return false;
+	size->QuadPart = (long long)st.st_size;
+	return true;
+}
+
+BOOL ReadFile(HANDLE file, void* buffer, DWORD count, DWORD* read, void*) {
+	const auto res = ::read(((PosixHandle*)file)->fd, buffer, count);
+	*read = res > 0 ? (DWORD)res : 0;
+	return res >= 0;
+}
+
+BOOL WriteFile(HANDLE file, const void* buffer, DWORD count, DWORD* written, void*) {
+	const auto res = ::write(((PosixHandle*)file)->fd, buffer, count);
+	*written = res > 0 ? (DWORD)res : 0;
+	return res >= 0;
+}
+
+HANDLE CreateFileMapping(HANDLE file, void*, DWORD, DWORD, DWORD, LPCSTR) { // Like Win32, empty files can't be mapped.
+	if (LARGE_INTEGER size = {}; !GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		return nullptr;
+	const int fd = dup(((PosixHandle*)file)->fd);
+	return fd < 0 ? nullptr : new PosixHandle{ fd };
+}
+
+void* MapViewOfFile(HANDLE mapping, DWORD, DWORD offset_high, DWORD offset_low, size_t size) {
+	const auto offset = ((long long)offset_high << 32) | offset_low;
+	if (LARGE_INTEGER file_size = {}; size == 0 && GetFileSizeEx(mapping, &file_size))
+		size = (size_t)(file_size.QuadPart - offset);
+	const auto mem = mmap(nullptr, size, PROT_READ, MAP_SHARED, ((PosixHandle*)mapping)->fd, (off_t)offset);
+	if (mem == MAP_FAILED)
+		return nullptr;
+	std::scoped_lock lock(views().mutex);
+	views().sizes[mem] = size;
+	return mem;
+}
+
+BOOL UnmapViewOfFile(const void* mem) {
+	std::scoped_lock lock(views().mutex);
+	if (const auto found = views().sizes.find(mem); found != views().sizes.end()) {
+		munmap((void*)mem, found->second);
+		views().sizes.erase(found);
+		return true;
+	}
+	return false;
+}
+
+BOOL MoveFileExA(LPCSTR from, LPCSTR to, DWORD) { return rename(from, to) == 0; }
+BOOL DeleteFileA(LPCSTR filename) { return unlink(filename) == 0; }
+
+BOOL FindNextFile(HANDLE search, WIN32_FIND_DATA* data) {
+	if (search == INVALID_HANDLE_VALUE)
+		return false;
+	const auto posix = (PosixHandle*)search;
+	const auto entry = readdir(posix->dir);
+	if (entry == nullptr)
+		return false;
+	struct stat st;
+	const auto path = posix->path + "/" + entry->d_name;
+	data->dwFileAttributes = stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+	snprintf(data->cFileName, sizeof(data->cFileName), "%s", entry->d_name);
+	return true;
+}
+
+HANDLE FindFirstFile(LPCSTR filter, WIN32_FIND_DATA* data) { // Filter is always "<dir>/*".
+	auto path = std::string(filter);
+	path.resize(path.size() - std::min(path.size(), (size_t)2));
+	const auto dir = opendir(path.c_str());
+	if (dir == nullptr)
+		return INVALID_HANDLE_VALUE;
+	const auto search = new PosixHandle{ -1, dir, path };
+	if (!FindNextFile(search, data)) {
+		CloseHandle(search);
+		return INVALID_HANDLE_VALUE;
+	}
+	return search;
+}
+
+BOOL FindClose(HANDLE search) { return CloseHandle(search); }
+
+#endif
+
@@ -1,22 +1,101 @@
 #pragma once
 
+struct Edit {
+	size_t offset = 0;
+	std::string removed;
+	std::string inserted;
+};
+
 class State {
-	std::string text;
+	Table text;
 	size_t cursor = 0;
 	unsigned begin_row = 0;
+	size_t begin_offset = 0; // Of begin_row, kept in sync on scroll and edit.
 	unsigned line_count = 0;
 
+	size_t generation = 0; // Bumped by every text change.
+	std::vector<Edit> edits; // Since last take_edits().
+	std::deque<std::pair<size_t, size_t>> changes; // Generation and lowest offset of recent text changes, for caches keyed by offset.
+
+	static inline constexpr size_t change_count = 256;
+
+	void changed(size_t offset) { // Logs the change that made the current generation.
+		changes.emplace_back(generation, offset);
+		if (changes.size() > change_count)
+			changes.pop_front();
+	}
+
+	void insert_text(size_t pos, const std::string_view s) {
+		if (s.size() > 0) {
+			pos = std::min(pos, text.size());
+			text.insert(pos, s);
+			begin_offset = text.find_row_begin(begin_row);
+			generation++;
+			changed(pos);
+			if (edits.size() > 0 && edits.back().offset + edits.back().inserted.size() == pos) { edits.back().inserted += s; }
+			else { edits.push_back({ pos, {}, std::string(s) }); }
+		}
+	}
+
+	std::string erase_text(size_t pos, size_t count) {
+		auto s = text.substr(pos, count);
+		if (s.size() > 0) {
+			text.erase(pos, s.size());
+			begin_offset = text.find_row_begin(begin_row);
+			generation++;
+			changed(pos);
+			if (edits.size() > 0 && edits.back().offset <= pos && edits.back().offset + edits.back().inserted.size() == pos + s.size()) {
+				edits.back().inserted.resize(edits.back().inserted.size() - s.size()); // Backspace over text just typed.
+				if (edits.back().removed.empty() && edits.back().inserted.empty()) { edits.pop_back(); }
+			}
+			else { edits.push_back({ pos, s, {} }); }
+		}
+		return s;
+	}
+
 public:
-	const std::string_view get_text() const { return text; }
-	void set_text(const std::string_view t) { text = t; }
-	void append_text(const std::string_view t) { text += t; }
+	const Table& get_text() const { return text; }
+	template <typename T>
+	void set_text(const T& t) { text.assign(t); begin_offset = text.find_row_begin(begin_row); edits.clear(); generation++; changed(0); }
+	void rebase(std::shared_ptr<const Store> store) { text.assign(store); begin_offset = text.find_row_begin(begin_row); } // Same contents, new backing store.
+	void append_text(const std::string_view t) { insert_text(text.size(), t); }
 
 	size_t get_cursor() const { return cursor; }
 	void set_cursor(size_t u) { cursor = u; }
 
 	unsigned get_begin_row() const { return begin_row; }
+	void set_begin_row(unsigned row) { begin_row = row; begin_offset = text.find_row_begin(row); }
+	size_t get_begin_offset() const { return begin_offset; }
 	void set_line_count(unsigned count) { line_count = count; }
 
+	size_t get_generation() const { return generation; }
+
+	size_t changed_since(size_t since) const { // Lowest offset changed after generation since, npos if none, 0 if the log doesn't reach back.
+		if (since == generation)
+			return std::string::npos;
+		if (changes.empty() || since >= generation || changes.front().first > since + 1)
+			return 0;
+		size_t lowest = std::string::npos;
+		for (auto change = changes.rbegin(); change != changes.rend() && change->first > since; ++change) {
+			lowest = std::min(lowest, change->second);
+		}
+		return lowest;
+	}
+
+	std::vector<Edit> take_edits() { return std::exchange(edits, {}); }
+
+	void revert(const std::vector<Edit>& undo) {
+		size_t lowest = text.size();
+		for (auto edit = undo.rbegin(); edit != undo.rend(); ++edit) {
+			text.erase(edit->offset, edit->inserted.size());
+			text.insert(edit->offset, edit->removed);
+			lowest = std::min(lowest, edit->offset);
+		}
+		begin_offset = text.find_row_begin(begin_row);
+		generation++;
+		changed(lowest);
+	}
+
 	Word incr(const Word& w) { return Word(text, w.end() < text.size() - 1 ? w.end() + 1 : w.end()); }
 	Word decr(const Word& w) { return Word(text, w.begin() > 0 ? w.begin() - 1 : 0); }
 
@@ -24,27 +103,12 @@ public:
 	Line decr(const Line& w) { return Line(text, w.begin() > 0 ? w.begin() - 1 : 0); }
 
 	unsigned find_cursor_row() const {
-		unsigned number = 0;
-		size_t index = 0;
-		while (index < text.size() && index < cursor) {
-			if (text[index++] == '\n')
-				number++;
-		}
-		return number;
+		return (unsigned)text.find_row(cursor);
 	}
 
 	std::pair<unsigned, size_t> find_cursor_row_and_col() const {
-		unsigned number = 0;
-		size_t last = 0;
-		size_t index = 0;
-		while (index < text.size() && index < cursor) {
-			if (text[index++] == '\n')
-			{
-				last = index;
-				number++;
-			}
-		}
-		return { number, cursor - last };
+		const auto row = text.find_row(cursor);
+		return { (unsigned)row, cursor - text.find_row_begin(row) };
 	}
 
 	size_t find_char(unsigned key) {
@@ -203,7 +267,8 @@ public:
 		if (std::islower(c)) { res = std::toupper(c);
 		} else { res = std::tolower(c); }
 		if (res != c) {
-			text[cursor] = res;
+			erase_text(cursor, 1);
+			insert_text(cursor, std::string_view(&res, 1));
 		}
 	}
 
@@ -297,81 +362,74 @@ public:
 		cursor_clamp();
 	}
 
-	void jump_down(unsigned skip) {
-		for (unsigned i = 0; i < skip; i++) { next_line(); }
+	void jump_to_row(unsigned row) { // Keeps the column like next_line() and prev_line().
+		const Line current(text, cursor);
+		const auto begin = text.find_row_begin(row); // Indexes only as far as the row; size() when past the last one.
+		const Line target(text, begin < text.size() ? begin : text.size() > 0 ? text.size() - 1 : 0);
+		cursor = target.to_absolute(current.to_relative(cursor));
 		cursor_clamp();
 	}
 
+	void jump_down(unsigned skip) {
+		jump_to_row(find_cursor_row() + skip);
+	}
+
 	void jump_up(unsigned skip) {
-		for (unsigned i = 0; i < skip; i++) { prev_line(); }
-		cursor_clamp();
+		const unsigned cursor_row = find_cursor_row();
+		jump_to_row(cursor_row > skip ? cursor_row - skip : 0);
 	}
 
 	void window_down() {
 		const unsigned cursor_row = find_cursor_row();
-		const unsigned down_row = cursor_row + line_count / 2;
-		const unsigned skip = down_row > cursor_row ? down_row - cursor_row : 0;
-		for (unsigned i = 0; i < skip; i++) { next_line(); }
-		cursor_clamp();
+		jump_to_row(cursor_row + line_count / 2);
 	}
 
 	void window_up() {
 		const unsigned cursor_row = find_cursor_row();
-		const unsigned up_row = cursor_row > line_count / 2 ? cursor_row - line_count / 2 : 0;
-		const unsigned skip = cursor_row - up_row;
-		for (unsigned i = 0; i < skip; i++) { prev_line(); }
-		cursor_clamp();
+		jump_to_row(cursor_row > line_count / 2 ? cursor_row - line_count / 2 : 0);
 	}
 
 	void window_top() {
 		const unsigned cursor_row = find_cursor_row();
-		const unsigned top_row = begin_row;
-		const unsigned skip = cursor_row - top_row;
-		for (unsigned i = 0; i < skip; i++) { prev_line(); }
-		cursor_clamp();
+		jump_to_row(std::min(begin_row, cursor_row));
 	}
 
 	void window_center() {
-		const unsigned cursor_row = find_cursor_row();
-		const unsigned middle_row = begin_row + line_count / 2;
-		const unsigned skip = middle_row > cursor_row ? middle_row - cursor_row : cursor_row - middle_row;
-		for (unsigned i = 0; i < skip; i++) { middle_row > cursor_row ? next_line() : prev_line(); }
-		cursor_clamp();
+		jump_to_row(begin_row + line_count / 2);
 	}
 
 	void window_bottom() {
 		const unsigned cursor_row = find_cursor_row();
-		const unsigned bottom_row = begin_row + line_count;
-		const unsigned skip = bottom_row > cursor_row ? bottom_row - cursor_row : 0;
-		for (unsigned i = 0; i < skip; i++) { next_line(); }
-		cursor_clamp();
+		jump_to_row(std::max(begin_row + line_count, cursor_row));
 	}
 
 	void cursor_clamp() {
 		const unsigned cursor_row = find_cursor_row();
-		begin_row = std::clamp(begin_row, cursor_row > line_count ? cursor_row - line_count : 0, cursor_row);
+		set_begin_row(std::clamp(begin_row, cursor_row > line_count ? cursor_row - line_count : 0, cursor_row));
 	}
 
 	void cursor_center() {
 		const unsigned cursor_row = find_cursor_row();
-		begin_row = cursor_row > line_count / 2 ? cursor_row - line_count / 2 : 0;
+		set_begin_row(cursor_row > line_count / 2 ? cursor_row - line_count / 2 : 0);
 	}
 
 	void cursor_top() {
 		const unsigned cursor_row = find_cursor_row();
-		begin_row = cursor_row;
+		set_begin_row(cursor_row);
 	}
 
 	void cursor_bottom() {
 		const unsigned cursor_row = find_cursor_row();
-		begin_row = cursor_row > line_count ? cursor_row - line_count : 0;
+		set_begin_row(cursor_row > line_count ? cursor_row - line_count : 0);
 	}
 
 	void remove_line_whitespace() {
 		if (text.size() > 0) {
-			while (is_line_whitespace(text[cursor])) {
-				text.erase(cursor, 1);
+			size_t count = 0;
+			while (is_line_whitespace(text[cursor + count])) {
+				count++;
 			}
+			erase_text(cursor, count);
 		}
 	}
 
@@ -496,21 +554,20 @@ public:
 	}
 
 	void insert(const std::string_view s) {
-		text.insert(cursor, s);
+		insert_text(cursor, s);
 		cursor = std::min(cursor + s.length(), text.size() - 1);
 	}
 
 	void erase_back() {
 		if (cursor > 0) {
-			text.erase(cursor - 1, 1);
+			erase_text(cursor - 1, 1);
 			cursor = cursor > 0 ? cursor - 1 : cursor;
 		}
 	}
 
 	std::string erase() {
 		if (text.size() > 0) {
-			const auto s = text.substr(cursor, 1);
-			text.erase(cursor, 1);
+			const auto s = erase_text(cursor, 1);
 			cursor = text.size() > 0 && cursor == text.size() ? cursor - 1 : cursor;
 			return s;
 		}
@@ -519,8 +576,7 @@ public:
 
 	std::string erase_if(char c) {
 		if (text.size() > 0 && text[cursor] == c) {
-			const auto s = text.substr(cursor, 1);
-			text.erase(cursor, 1);
+			const auto s = erase_text(cursor, 1);
 			cursor = text.size() > 0 && cursor == text.size() ? cursor - 1 : cursor;
 			return s;
 		}
@@ -529,8 +585,7 @@ public:
 
 	std::string erase_all_up() {
 		if (text.size() > 0) {
-			const auto s = text.substr(0, cursor);
-			text.erase(0, cursor);
+			const auto s = erase_text(0, cursor);
 			cursor = 0;
 			return s;
 		}
@@ -539,8 +594,7 @@ public:
 
 	std::string erase_all_down() {
 		if (text.size() > 0) {
-			const auto s = text.substr(cursor, text.size() - cursor);
-			text.erase(cursor, text.size() - cursor);
+			const auto s = erase_text(cursor, text.size() - cursor);
 			cursor = std::min(cursor, text.size() - 1);
 			return s;
 		}
@@ -550,8 +604,7 @@ public:
 	std::string erase_to(unsigned key) {
 		if (text.size() > 0) {
 			if (const auto pos = find_char(key); pos != std::string::npos) {
-				const auto s = text.substr(cursor, pos - cursor + 1);
-				text.erase(cursor, pos - cursor + 1);
+				const auto s = erase_text(cursor, pos - cursor + 1);
 				return s;
 			}
 		}
@@ -561,8 +614,7 @@ public:
 	std::string erase_until(unsigned key) {
 		if (text.size() > 0) {
 			if (const auto pos = find_char(key); pos != std::string::npos) {
-				const auto s = text.substr(cursor, pos - cursor);
-				text.erase(cursor, pos - cursor);
+				const auto s = erase_text(cursor, pos - cursor);
 				return s;
 			}
 		}
@@ -572,8 +624,7 @@ public:
 	std::string erase_line() {
 		if (text.size() > 0) {
 			const Line current(text, cursor);
-			const auto s = text.substr(current.begin(), current.end() - current.begin() + 1);
-			text.erase(current.begin(), current.end() - current.begin() + 1);
+			const auto s = erase_text(current.begin(), current.end() - current.begin() + 1);
 			cursor = std::min(current.begin(), text.size() - 1);
 			return s;
 		}
@@ -583,8 +634,7 @@ public:
 	std::string erase_line_contents() {
 		if (text.size() > 0) {
 			const Line current(text, cursor);
-			const auto s = text.substr(current.begin(), current.end() - current.begin());
-			text.erase(current.begin(), current.end() - current.begin());
+			const auto s = erase_text(current.begin(), current.end() - current.begin());
 			cursor = std::min(current.begin(), text.size() - 1);
 			return s;
 		}
@@ -594,8 +644,7 @@ public:
 	std::string erase_to_line_end() {
 		if (text.size() > 0) {
 			const Line current(text, cursor);
-			const auto s = text.substr(cursor, current.end() - cursor);
-			text.erase(cursor, current.end() - cursor);
+			const auto s = erase_text(cursor, current.end() - cursor);
 			cursor = std::min(cursor, text.size() - 1);
 			return s;
 		}
@@ -627,8 +676,7 @@ public:
 			const Word current(text, cursor);
 			const auto begin = from_cursor ? cursor : current.begin();
 			const auto count = std::min(current.end() + 1, text.size() - 1) - begin;
-			const auto s = text.substr(begin, count);
-			text.erase(begin, count);
+			const auto s = erase_text(begin, count);
 			cursor = begin;
 			return s;
 		}
@@ -649,8 +697,7 @@ public:
 			if (current.valid()) {
 				const auto begin = inclusive ? current.begin() : current.begin() + 1;
 				const auto end = inclusive ? current.end() : current.end() - 1;
-				const auto s = text.substr(begin, end - begin + 1);
-				text.erase(begin, end - begin + 1);
+				const auto s = erase_text(begin, end - begin + 1);
 				cursor = begin;
 				return s;
 			}
@@ -752,57 +799,109 @@ public:
 	void fix_eof() {
 		const auto size = text.size();
 		if (size == 0 || (size > 0 && text[size - 1] != '\n')) {
-			text += '\n';
+			insert_text(size, "\n");
 		}
 	}
 };
 
+struct Step {
+	size_t cursor = 0;
+	unsigned begin_row = 0;
+	std::vector<Edit> edits;
+	size_t bytes = 0;
+};
+
 class Stack {
-	std::vector<State> states;
+	State current;
+	std::deque<Step> steps; // Oldest first.
+	size_t bytes = 0;
+	size_t budget = 0; // Journal only; text inserted into the piece table stays until reloaded.
+
+	size_t cursor = 0; // Saved by push() for the next step.
+	unsigned begin_row = 0;
+	size_t generation = 0;
+
 	bool undo = false;
 
+	void record(std::vector<Edit> edits) {
+		Step step = { cursor, begin_row, std::move(edits), sizeof(Step) };
+		for (const auto& edit : step.edits) {
+			step.bytes += sizeof(Edit) + edit.removed.size() + edit.inserted.size();
+		}
+		bytes += step.bytes;
+		steps.push_back(std::move(step));
+		while (bytes > budget && steps.size() > 1) { // The newest step stays undoable, however large.
+			bytes -= steps.front().bytes;
+			steps.pop_front();
+		}
+	}
+
+	void revert() {
+		if (steps.size() > 0) {
+			const auto& step = steps.back();
+			current.revert(step.edits);
+			current.set_cursor(step.cursor);
+			current.set_begin_row(step.begin_row);
+			bytes -= step.bytes;
+			steps.pop_back();
+		}
+	}
+
 public:
-	Stack() {
-		states.clear();
-		states.emplace_back();
-		states.back().fix_eof();
+	static inline constexpr size_t default_budget = 64 * 1024 * 1024;
+
+	Stack(size_t budget = default_budget)
+		: budget(budget) {
+		current.fix_eof();
+		current.take_edits();
 	}
 
-	State& state() { return states.back(); }
-	const State& state() const { return states.back(); }
+	State& state() { return current; }
+	const State& state() const { return current; }
 
-	const std::string_view get_text() const { return states.back().get_text(); }
-	void set_text(const std::string_view text) { states.back().set_text(text); }
-	void append_text(const std::string_view text) { states.back().append_text(text); }
+	const Table& get_text() const { return current.get_text(); }
+	template <typename T>
+	void set_text(const T& text) {
+		current.set_text(text);
+		current.fix_eof();
+		current.take_edits();
+		steps.clear();
+		bytes = 0;
+	}
+	void append_text(const std::string_view text) { current.append_text(text); } // Journaled with the enclosing step.
+	void rebase(std::shared_ptr<const Store> store) { current.rebase(store); }
 
-	size_t get_cursor() const { return states.back().get_cursor(); }
-	void set_cursor(size_t u) { states.back().set_cursor(u); }
+	size_t get_cursor() const { return current.get_cursor(); }
+	void set_cursor(size_t u) { current.set_cursor(u); }
 
 	void set_undo() { undo = true; }
 
+	void set_budget(size_t b) { budget = b; }
+
 	void push() {
-		if (states.size() > 100) { states.erase(states.begin()); }
-		if (states.size() > 0) { states.push_back(states.back()); }
-	}
-
-	bool pop() {
-		bool modified = false;
-		if (states.size() > 1) {
-			auto& last = states[states.size() - 1];
-			auto& previous = states[states.size() - 2];
-			modified = last.get_text() != previous.get_text();
-			if (!modified) {
-				std::swap(previous, last);
-				states.pop_back();
-			}
+		cursor = current.get_cursor();
+		begin_row = current.get_begin_row();
+		generation = current.get_generation();
+	}
+
+	void pop() {
+		std::vector<Edit> edits;
+		if (current.get_generation() != generation) { // Nothing to journal after pure motions.
+			edits = current.take_edits();
+			std::erase_if(edits, [](const auto& edit) { return edit.removed == edit.inserted; }); // Text retyped as it was.
 		}
 		if (undo) {
 			undo = false;
-			if (states.size() > 1)
-				states.pop_back();
+			revert();
+		}
+		const bool modified = edits.size() > 0;
+		current.fix_eof();
+		for (auto& edit : current.take_edits()) {
+			edits.push_back(std::move(edit));
+		}
+		if (modified) {
+			record(std::move(edits));
 		}
-		states.back().fix_eof();
-		return modified;
 	}
 };
 
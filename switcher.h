@@ -0,0 +1,192 @@
+#pragma once
+
+class Switcher {
+	std::vector<Buffer> buffers;
+	size_t active = 0;
+
+	std::string clipboard;
+	std::string error; // Last failed file operation, shown until the next key.
+
+	size_t culled = (size_t)-1; // Buffer shown by the last cull.
+
+	Buffer& current() { return buffers[active]; }
+	const Buffer& current() const { return buffers[active]; }
+
+	void select_index(unsigned index) { active = index >= 0 && index < buffers.size() ? index : active; }
+	void select_previous() { active = active > 0 ? active - 1 : buffers.size() - 1; }
+	void select_next() { active = (active + 1) % buffers.size(); }
+
+	size_t find_buffer(const std::string_view filename) {
+		for (size_t i = 0; i < buffers.size(); ++i) {
+			if (buffers[i].get_filename() == filename)
+				return i;
+		}
+		return (size_t)-1;
+	}
+
+	bool open_and_jump(const std::string_view url) {
+		const auto filename = extract_filename(url);
+		if (std::filesystem::exists(filename)) {
+			open(filename);
+			current().jump(extract_location(url));
+			return true;
+		}
+		return false;
+	}
+
+	void fail(const std::string_view what, const std::string_view filename) {
+		error = std::string(what) + " " + std::string(filename) + " (error " + std::to_string(GetLastError()) + ")";
+	}
+
+	void reload() {
+		if (const auto store = load(current().get_filename()))
+			current().init(store);
+		else
+			fail("cannot read", current().get_filename());
+	}
+
+	void save() { // The buffer may be reading from a mapping of the file, which can't be rewritten while mapped, so write aside first.
+		const auto filename = std::string(current().get_filename());
+		const auto temp = filename + ".tmp";
+		const auto size = current().get_text().size();
+		if (!write(temp, current().get_text())) {
+			fail("cannot write", temp);
+			DeleteFileA(temp.c_str());
+			return;
+		}
+		if (const auto store = load(temp); store && store->size() == size) {
+			current().rebase(store); // Releases the mapping of the file.
+		}
+		else {
+			fail("cannot read", temp);
+			DeleteFileA(temp.c_str());
+			return;
+		}
+		if (write(filename, current().get_text(), TRUNCATE_EXISTING)) { // In place, keeping attributes, ACLs and hard links.
+			const auto store = load(filename);
+			current().rebase(store && store->size() == size ? store : copy_store(current().get_text()));
+			DeleteFileA(temp.c_str());
+			current().set_dirty(false);
+		}
+		else if (MoveFileExA(temp.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING)) { // New file, or one we can't write to.
+			current().set_dirty(false); // The buffer's mapping moved with the file.
+		}
+		else {
+			fail("cannot save", filename);
+			current().rebase(copy_store(current().get_text())); // Stays dirty, so the text is still there to retry.
+			DeleteFileA(temp.c_str());
+		}
+	}
+
+	void close() {
+		if (active > 0) { // Don't close buffer 0.
+			const auto filename = std::string(current().get_filename());
+			buffers.erase(buffers.begin() + active);
+			culled = (size_t)-1;
+			active = (active >= buffers.size() ? active - 1 : active) % buffers.size();
+		}
+	}
+
+	void process_space_e() {
+		open("list");
+		current().init(list());
+		current().set_dirty(true);
+	}
+
+	void process_space_f() {
+		const auto seed = current().get_word();
+		open(std::string("find ") + seed);
+		current().init(find(seed));
+		current().set_highlight(seed);
+	}
+
+	void process_space(bool& quit, bool& maximize, bool& fields, double& font_size, unsigned key) {
+		if (key == 'q') { quit = true; }
+		else if (key == 'm') { maximize = true; }
+		else if (key == 'd') { fields = true; }
+		else if (key == '+') { font_size = std::min(font_size + 1.0, 80.0); }
+		else if (key == '-') { font_size = std::max(font_size - 1.0, 8.0); }
+		else if (key == 'w') { close(); }
+		else if (key == 'r') { reload(); }
+		else if (key == 's') { save(); }
+		else if (key == 'e') { process_space_e(); }
+		else if (key == 'f') { process_space_f(); }
+		else if (key == 'j') { current().window_down(); }
+		else if (key == 'k') { current().window_up(); }
+		else if (key == 'h') { select_previous(); }
+		else if (key == 'l') { select_next(); }
+		else if (key == 'n') { current().clear_highlight(); }
+		else if (key >= '0' && key <= '9') { select_index(key - '0'); }
+	}
+
+	void process_normal(unsigned key) {
+		bool jump = false;
+		current().process(clipboard, jump, key);
+		if (jump) {
+			if (!open_and_jump(current().get_url()))
+				open_and_jump(current().get_line_url());
+		}
+	}
+
+	void push_status(Characters& characters, unsigned col_count, const std::string_view text, const std::string_view status) const {
+		const unsigned row = 0;
+		unsigned col = 0;
+		push_line(characters, colors().status, row, col, col_count);
+		push_string(characters, colors().status_text, row, col, text);
+		push_string(characters, colors().status_text, row, col, "  ");
+		push_string(characters, colors().status_text, row, col, status);
+	}
+
+	void push_tabs(Characters& characters) const {
+		const unsigned row = 1;
+		unsigned col = 0;
+		for (unsigned i = 0; i < buffers.size(); ++i) {
+			const auto back_color = i == active ? colors().bar_text : colors().bar;
+			const auto fore_color = i == active ? colors().bar : colors().bar_text;
+			const auto text = std::string(buffers[i].get_filename()) + (buffers[i].is_dirty() ? "*" : "");
+			push_line(characters, back_color, row, col, col + (int)(1 + text.size()));
+			characters.emplace_back(superscript_codepoint(i), fore_color, row, col++);
+			push_string(characters, fore_color, row, col, text);
+			col += 1;
+		}
+	}
+
+public:
+	Switcher() {
+		open("");
+	}
+
+	void open(const std::string_view filename) {
+		if (auto index = find_buffer(filename); index != (size_t)-1) {
+			active = index;
+		}
+		else if (buffers.size() < 10) { // No more than 10 tabs so we can use numbered fast switch.
+			buffers.emplace_back(filename);
+			active = buffers.size() - 1;
+			if (const auto store = load(filename)) {
+				current().init(store);
+			}
+			else {
+				fail("cannot read", filename);
+				current().init("\n");
+			}
+		}
+	}
+
+	void process(bool space_down, bool& quit, bool& maximize, bool& fields, double& font_size, unsigned key) {
+		error.clear();
+		if (space_down && current().is_normal()) { process_space(quit, maximize, fields, font_size, key); }
+		else { process_normal(key); }
+	}
+
+	Characters cull(unsigned col_count, unsigned row_count, const std::string_view text, int& scroll) { // Scroll is how many rows the text moved up, for the renderer to reuse.
+		Characters characters;
+		push_status(characters, col_count, text, error.empty() ? current().status() : error);
+		push_tabs(characters);
+		current().set_line_count(current().cull(characters, col_count, row_count));
+		scroll = active == culled ? current().get_scroll() : 0;
+		culled = active;
+		return characters;
+	}
+};
+
@@ -0,0 +1,400 @@
+#pragma once
+
+TARGET_AVX2 size_t scan_newlines_avx2(const std::string_view s, size_t& i) { // Counts whole 32-byte blocks, advancing i.
+	size_t count = 0;
+	const auto nl = _mm256_set1_epi8('\n');
+	while (i + 32 <= s.size()) {
+		auto sums = _mm256_setzero_si256();
+		for (unsigned j = 0; j < 255 && i + 32 <= s.size(); ++j, i += 32) { // Byte counters wrap after 255 steps.
+			sums = _mm256_sub_epi8(sums, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&s[i]), nl));
+		}
+		alignas(32) uint64_t lanes[4];
+		_mm256_store_si256((__m256i*)lanes, _mm256_sad_epu8(sums, _mm256_setzero_si256()));
+		count += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	_mm256_zeroupper();
+	return count;
+}
+
+size_t scan_newlines(const std::string_view s) { // Number of '\n' in s.
+	size_t count = 0;
+	size_t i = 0;
+	if (use_avx2)
+		count += scan_newlines_avx2(s, i);
+	const auto nl = _mm_set1_epi8('\n');
+	while (i + 16 <= s.size()) {
+		auto sums = _mm_setzero_si128();
+		for (unsigned j = 0; j < 255 && i + 16 <= s.size(); ++j, i += 16) {
+			sums = _mm_sub_epi8(sums, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&s[i]), nl));
+		}
+		alignas(16) uint64_t lanes[2];
+		_mm_store_si128((__m128i*)lanes, _mm_sad_epu8(sums, _mm_setzero_si128()));
+		count += lanes[0] + lanes[1];
+	}
+	return count + std::count(s.begin() + i, s.end(), '\n');
+}
+
+size_t nth_newline(size_t offset, uint32_t mask, size_t& n) { // Consumes n, returns the offset once reached.
+	const auto count = (size_t)std::popcount(mask);
+	if (n >= count) {
+		n -= count;
+		return std::string::npos;
+	}
+	for (; n > 0; --n) { mask &= mask - 1; } // Drop lower newlines.
+	return offset + std::countr_zero(mask);
+}
+
+TARGET_AVX2 size_t seek_newline_avx2(const std::string_view s, size_t& i, size_t& n) { // Whole 32-byte blocks, advancing i.
+	const auto nl = _mm256_set1_epi8('\n');
+	for (; i + 32 <= s.size(); i += 32) {
+		const auto mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&s[i]), nl));
+		if (const auto at = nth_newline(i, mask, n); at != std::string::npos) { _mm256_zeroupper(); return at; }
+	}
+	_mm256_zeroupper();
+	return std::string::npos;
+}
+
+size_t seek_newline(const std::string_view s, size_t n = 0) { // Offset of the n-th '\n' in s (0-based).
+	size_t i = 0;
+	if (use_avx2)
+		if (const auto at = seek_newline_avx2(s, i, n); at != std::string::npos)
+			return at;
+	const auto nl = _mm_set1_epi8('\n');
+	for (; i + 16 <= s.size(); i += 16) {
+		const auto mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&s[i]), nl));
+		if (const auto at = nth_newline(i, mask, n); at != std::string::npos)
+			return at;
+	}
+	for (; i < s.size(); ++i) {
+		if (s[i] == '\n' && n-- == 0)
+			return i;
+	}
+	return std::string::npos;
+}
+
+class Store {
+	std::string data;
+	std::shared_ptr<const char> memory; // Mapped file used in place of data, never copied.
+	size_t memory_size = 0;
+
+	mutable std::vector<size_t> newlines; // Sorted positions of '\n', indexed lazily.
+	mutable size_t indexed = 0;
+
+	static inline constexpr size_t index_step = 1024 * 1024;
+
+	void index(size_t end) const { // Extends newlines to cover [0, end).
+		const auto s = view();
+		if (end > indexed) {
+			end = std::min(std::max(end, indexed + index_step), s.size());
+			const auto range = s.substr(0, end);
+			for (auto at = seek_newline(range.substr(indexed)); at != std::string::npos; at = seek_newline(range.substr(indexed))) {
+				newlines.push_back(indexed + at);
+				indexed += at + 1;
+			}
+			indexed = end;
+		}
+	}
+
+public:
+	Store() {}
+	Store(std::shared_ptr<const char> memory, size_t size)
+		: memory(memory), memory_size(size) {
+	}
+
+	std::string_view view() const { return memory ? std::string_view(memory.get(), memory_size) : std::string_view(data); }
+	size_t size() const { return memory ? memory_size : data.size(); }
+
+	size_t count_newlines(size_t begin, size_t end) const {
+		index(end);
+		return std::lower_bound(newlines.begin(), newlines.end(), end) -
+			std::lower_bound(newlines.begin(), newlines.end(), begin);
+	}
+
+	size_t find_newline(size_t begin, size_t end, size_t n) const { // Position of the n-th '\n' (1-based) in [begin, end).
+		for (;;) {
+			const auto first = std::lower_bound(newlines.begin(), newlines.end(), begin) - newlines.begin();
+			if (newlines.size() - first >= n)
+				return newlines[first + n - 1] < end ? newlines[first + n - 1] : std::string::npos;
+			if (indexed >= std::min(end, size()))
+				return std::string::npos;
+			index(indexed + 1);
+		}
+	}
+
+	void append(const std::string_view s) { // Owned data only.
+		index(data.size());
+		newlines.reserve(newlines.size() + scan_newlines(s));
+		for (size_t pos = 0, at = seek_newline(s); at != std::string::npos; pos += at + 1, at = seek_newline(s.substr(pos))) {
+			newlines.push_back(data.size() + pos + at);
+		}
+		data += s;
+		indexed = data.size();
+	}
+};
+
+struct Piece {
+	bool added = false; // Points into the add buffer instead of the original one.
+	size_t offset = 0;
+	size_t length = 0;
+
+	bool operator==(const Piece&) const = default;
+};
+
+class Table {
+	std::shared_ptr<const Store> original = std::make_shared<Store>();
+	std::shared_ptr<Store> added = std::make_shared<Store>(); // Append-only, so copies can keep sharing it.
+	std::vector<Piece> pieces;
+	std::vector<size_t> ends; // Running total of piece lengths, for binary search.
+	mutable std::vector<size_t> rows; // Running total of piece newlines, for a prefix of pieces extended on demand.
+
+	const Store& store(const Piece& piece) const {
+		return piece.added ? *added : *original;
+	}
+
+	std::string_view view(const Piece& piece) const {
+		return store(piece).view().substr(piece.offset, piece.length);
+	}
+
+	size_t count_newlines(const Piece& piece, size_t length) const { // In the first length bytes of the piece.
+		return store(piece).count_newlines(piece.offset, piece.offset + length);
+	}
+
+	size_t count_rows(size_t index) const { // Newlines in the pieces before index.
+		while (rows.size() < index) {
+			const auto& piece = pieces[rows.size()];
+			rows.push_back((rows.empty() ? 0 : rows.back()) + count_newlines(piece, piece.length));
+		}
+		return index > 0 ? rows[index - 1] : 0;
+	}
+
+	size_t find_piece(size_t pos) const {
+		return std::upper_bound(ends.begin(), ends.end(), pos) - ends.begin();
+	}
+
+	size_t piece_begin(size_t index) const {
+		return index > 0 ? ends[index - 1] : 0;
+	}
+
+	void rebuild(size_t from) { // Pieces before from are unchanged.
+		ends.resize(pieces.size());
+		for (size_t i = from; i < pieces.size(); ++i) {
+			ends[i] = piece_begin(i) + pieces[i].length;
+		}
+		rows.resize(std::min(rows.size(), from));
+	}
+
+	size_t split(size_t pos) { // Returns the index of the piece starting at pos.
+		const auto index = find_piece(pos);
+		if (index < pieces.size()) {
+			const auto begin = piece_begin(index);
+			if (pos > begin) {
+				Piece right = pieces[index];
+				right.offset += pos - begin;
+				right.length -= pos - begin;
+				pieces[index].length = pos - begin;
+				pieces.insert(pieces.begin() + index + 1, right);
+				rebuild(index);
+				return index + 1;
+			}
+		}
+		return index;
+	}
+
+public:
+	class Iterator {
+		const Table* table = nullptr;
+		size_t index = 0;
+		size_t offset = 0;
+		const char* data = nullptr;
+		size_t length = 0;
+
+		void load() {
+			const auto chunk = index < table->pieces.size() ? table->view(table->pieces[index]) : std::string_view();
+			data = chunk.data();
+			length = chunk.size();
+		}
+
+	public:
+		Iterator(const Table* table, size_t index, size_t offset)
+			: table(table), index(index), offset(offset) {
+			load();
+		}
+
+		const char& operator*() const { return data[offset]; }
+
+		Iterator& operator++() {
+			if (++offset == length) {
+				index++;
+				offset = 0;
+				load();
+			}
+			return *this;
+		}
+
+		bool operator==(const Iterator& other) const { return index == other.index && offset == other.offset; }
+	};
+
+	Iterator begin() const { return Iterator(this, 0, 0); }
+	Iterator end() const { return Iterator(this, pieces.size(), 0); }
+	Iterator at(size_t pos) const { const auto index = find_piece(pos); return Iterator(this, index, pos - piece_begin(index)); }
+
+	size_t size() const { return ends.empty() ? 0 : ends.back(); }
+	bool empty() const { return size() == 0; }
+
+	size_t row_count() const { return count_rows(pieces.size()); } // Number of newlines.
+
+	size_t find_row(size_t pos) const { // Number of newlines before pos.
+		pos = std::min(pos, size());
+		const auto index = find_piece(pos);
+		const auto before = count_rows(index);
+		return index < pieces.size() ? before + count_newlines(pieces[index], pos - piece_begin(index)) : before;
+	}
+
+	size_t find_row_begin(size_t row) const { // Offset following the row-th newline.
+		if (row == 0)
+			return 0;
+		auto index = (size_t)(std::lower_bound(rows.begin(), rows.end(), row) - rows.begin());
+		for (; index < pieces.size(); ++index) { // Only indexes as far as the row, not the whole piece.
+			const auto& piece = pieces[index];
+			const auto before = count_rows(index);
+			if (const auto at = store(piece).find_newline(piece.offset, piece.offset + piece.length, row - before); at != std::string::npos)
+				return piece_begin(index) + at - piece.offset + 1;
+		}
+		return size();
+	}
+
+	char operator[](size_t pos) const {
+		if (pos < size()) {
+			const auto index = find_piece(pos);
+			return view(pieces[index])[pos - piece_begin(index)];
+		}
+		return '\0';
+	}
+
+	template <typename F>
+	void process_pieces(F func) const {
+		for (const auto& piece : pieces) {
+			func(view(piece));
+		}
+	}
+
+	bool matches(size_t pos, const std::string_view s) const {
+		if (pos > size() || s.size() > size() - pos)
+			return false;
+		size_t done = 0;
+		for (auto index = find_piece(pos); done < s.size(); ++index) {
+			const auto chunk = view(pieces[index]).substr(pos + done - piece_begin(index));
+			const auto count = std::min(chunk.size(), s.size() - done);
+			if (chunk.substr(0, count) != s.substr(done, count))
+				return false;
+			done += count;
+		}
+		return true;
+	}
+
+	size_t find(const std::string_view s, size_t pos = 0) const {
+		if (s.empty())
+			return pos <= size() ? pos : std::string::npos;
+		if (s == "\n") { // Answered by the newline index.
+			const auto begin = find_row_begin(find_row(pos) + 1);
+			return begin > pos && (*this)[begin - 1] == '\n' ? begin - 1 : std::string::npos;
+		}
+		for (auto index = find_piece(pos); index < pieces.size(); ++index) {
+			const auto begin = piece_begin(index);
+			const auto chunk = view(pieces[index]);
+			for (auto at = chunk.find(s[0], pos > begin ? pos - begin : 0); at != std::string::npos; at = chunk.find(s[0], at + 1)) {
+				if (matches(begin + at, s))
+					return begin + at;
+			}
+		}
+		return std::string::npos;
+	}
+
+	size_t rfind(const std::string_view s, size_t pos = std::string::npos) const {
+		if (s.size() > size())
+			return std::string::npos;
+		pos = std::min(pos, size() - s.size());
+		if (s.empty())
+			return pos;
+		if (s == "\n") {
+			const auto row = find_row(pos + 1);
+			return row > 0 ? find_row_begin(row) - 1 : std::string::npos;
+		}
+		for (auto index = find_piece(pos) + 1; index-- > 0;) {
+			const auto begin = piece_begin(index);
+			const auto chunk = view(pieces[index]);
+			for (auto at = chunk.rfind(s[0], pos - begin); at != std::string::npos; at = at > 0 ? chunk.rfind(s[0], at - 1) : std::string::npos) {
+				if (matches(begin + at, s))
+					return begin + at;
+			}
+		}
+		return std::string::npos;
+	}
+
+	std::string substr(size_t pos, size_t count = std::string::npos) const {
+		std::string res;
+		if (pos < size()) {
+			count = std::min(count, size() - pos);
+			res.reserve(count);
+			for (auto index = find_piece(pos); res.size() < count; ++index) {
+				const auto chunk = view(pieces[index]).substr(pos + res.size() - piece_begin(index));
+				res += chunk.substr(0, count - res.size());
+			}
+		}
+		return res;
+	}
+
+	void assign(std::shared_ptr<const Store> store) {
+		original = store;
+		added = std::make_shared<Store>();
+		pieces.clear();
+		if (original->size() > 0)
+			pieces.push_back({ false, 0, original->size() });
+		rebuild(0);
+	}
+
+	void assign(const std::string_view s) {
+		auto store = std::make_shared<Store>();
+		store->append(s);
+		assign(store);
+	}
+
+	void insert(size_t pos, const std::string_view s) {
+		if (s.empty())
+			return;
+		pos = std::min(pos, size());
+		const auto offset = added->size();
+		added->append(s);
+		const auto index = find_piece(pos);
+		if (index > 0 && piece_begin(index) == pos && pieces[index - 1].added && pieces[index - 1].offset + pieces[index - 1].length == offset) {
+			pieces[index - 1].length += s.size(); // Typing at the end of the last insertion.
+			rebuild(index - 1);
+		}
+		else {
+			const Piece piece = { true, offset, s.size() };
+			const auto at = split(pos);
+			pieces.insert(pieces.begin() + at, piece);
+			rebuild(at);
+		}
+	}
+
+	void append(const std::string_view s) {
+		insert(size(), s);
+	}
+
+	void erase(size_t pos, size_t count) {
+		if (pos < size()) {
+			count = std::min(count, size() - pos);
+			const auto first = split(pos);
+			const auto last = split(pos + count);
+			pieces.erase(pieces.begin() + first, pieces.begin() + last);
+			rebuild(first);
+		}
+	}
+
+	void replace(size_t pos, size_t count, const std::string_view s) {
+		erase(pos, count);
+		insert(pos, s);
+	}
+};
+
@@ -46,6 +46,8 @@ struct Color {
 
 	Color& set_alpha(uint8_t alpha) { a = alpha; return *this; }
 
+	bool operator==(const Color&) const = default;
+
 	static uint8_t blend(const uint8_t s, const uint8_t d, const uint8_t a) { return ((s * (255 - a)) + (d * a)) >> 8; }
 
 	void blend(const Color& dst) {
@@ -128,6 +130,8 @@ struct Character {
 	Character() {}
 	Character(uint16_t index, Color color, unsigned row, unsigned col)
 		: index(index), color(color), row(row), col(col) {}
+
+	bool operator==(const Character&) const = default;
 };
 
 typedef std::vector<Character> Characters;
@@ -202,21 +206,24 @@ public:
 class Word : public Range {
 	size_t finish_no_whitespace = 0;
 
-	bool test_letter_or_number(const std::string_view text, size_t pos) {
+	template <typename T>
+	bool test_letter_or_number(const T& text, size_t pos) {
 		if (pos < text.size()) {
 			return is_number(text[pos]) || is_letter(text[pos]);
 		}
 		return false;
 	}
 
-	bool test_whitespace(const std::string_view text, size_t pos) {
+	template <typename T>
+	bool test_whitespace(const T& text, size_t pos) {
 		if (pos < text.size()) {
 			return is_line_whitespace(text[pos]);
 		}
 		return false;
 	}
 
-	bool test_punctuation(const std::string_view text, size_t pos) {
+	template <typename T>
+	bool test_punctuation(const T& text, size_t pos) {
 		if (pos < text.size()) {
 			return is_punctuation(text[pos]);
 		}
@@ -224,7 +231,8 @@ class Word : public Range {
 	}
 
 public:
-	Word(const std::string_view text, size_t pos) {
+	template <typename T>
+	Word(const T& text, size_t pos) {
 		if (text.size() > 0 && pos < text.size()) {
 			start = pos;
 			finish = pos;
@@ -249,13 +257,15 @@ public:
 		}
 	}
 
-	std::string_view to_string(const std::string_view text) const {
+	template <typename T>
+	auto to_string(const T& text) const {
 		return text.substr(start, finish_no_whitespace - start + 1);
 	}
 };
 
 class Enclosure : public Range {
-	size_t find_prev(const std::string_view text, size_t pos, uint16_t left, uint16_t right) {
+	template <typename T>
+	size_t find_prev(const T& text, size_t pos, uint16_t left, uint16_t right) {
 		unsigned count = 1;
 		size_t index = pos > 0 && text[pos] == right ? pos - 1 : pos;
 		while (index < text.size() && count > 0) {
@@ -267,7 +277,8 @@ class Enclosure : public Range {
 		return count == 0 ? index : std::string::npos;
 	}
 
-	size_t find_next(const std::string_view text, size_t pos, uint16_t left, uint16_t right) {
+	template <typename T>
+	size_t find_next(const T& text, size_t pos, uint16_t left, uint16_t right) {
 		unsigned count = 1;
 		size_t index = text[pos] == left ? pos + 1 : pos;
 		while (index < text.size() && count > 0) {
@@ -280,7 +291,8 @@ class Enclosure : public Range {
 	}
 
 public:
-	Enclosure(const std::string_view text, size_t pos, uint16_t left, uint16_t right) {
+	template <typename T>
+	Enclosure(const T& text, size_t pos, uint16_t left, uint16_t right) {
 		if (text.size() > 0 && pos < text.size()) {
 			start = pos;
 			finish = pos;
@@ -293,14 +305,16 @@ public:
 		}
 	}
 
-	std::string_view to_string(const std::string_view text) const {
+	template <typename T>
+	auto to_string(const T& text) const {
 		return text.substr(start + 1, finish - start);
 	}
 };
 
 class Line : public Range {
 public:
-	Line(const std::string_view text, size_t pos) {
+	template <typename T>
+	Line(const T& text, size_t pos) {
 		if (text.size() > 0 && pos < text.size()) {
 			const auto pn = text.rfind("\n", pos > 0 && text[pos] == '\n' ? pos - 1 : pos);
 			const auto nn = text.find("\n", pos);
@@ -319,7 +333,8 @@ public:
 		return std::min(start + pos, finish);
 	}
 
-	std::string_view to_string(const std::string_view text) const {
+	template <typename T>
+	auto to_string(const T& text) const {
 		return text.substr(start, finish - start + 1);
 	}
 
@@ -331,7 +346,8 @@ public:
 };
 
 class Url : public Range {
-	bool test(const std::string_view text, size_t pos) {
+	template <typename T>
+	bool test(const T& text, size_t pos) {
 		if (pos < text.size()) {
 			return is_number(text[pos]) || is_letter(text[pos]) || is_url_punctuation(text[pos]);
 		}
@@ -339,7 +355,8 @@ class Url : public Range {
 	}
 
 public:
-	Url(const std::string_view text, size_t pos) {
+	template <typename T>
+	Url(const T& text, size_t pos) {
 		if (text.size() > 0 && pos < text.size()) {
 			start = pos;
 			finish = pos;
@@ -349,7 +366,8 @@ public:
 		}
 	}
 
-	std::string_view to_string(const std::string_view text) const {
+	template <typename T>
+	auto to_string(const T& text) const {
 		return text.substr(start, finish - start + 1);
 	}
 };
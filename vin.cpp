@@ -7,25 +7,50 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <assert.h>
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <charconv>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <span>
 #include <unordered_map>
 #include <iostream>
 #include <filesystem>
 #include <sstream>
+#include <fstream>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <intrin.h>
+#include <immintrin.h>
 #include <windows.h>
 #include <psapi.h>
 #include <dwmapi.h>
 #include <shlobj.h>
 
 #include "resource.h"
+#include "platform.h"
 #include "text.h"
+#include "table.h"
 #include "state.h"
 #include "buffer.h"
 #include "file.h"
+#include "workers.h"
 #include "font.h"
+#include "frame.h"
+#include "switcher.h"
 
 const unsigned version_major = 1;
 const unsigned version_minor = 4;
@@ -96,12 +121,14 @@ class Window {
 		info.bmiHeader.biHeight = -(LONG)height; // Negative so (0,0) is at top left.
 		info.bmiHeader.biPlanes = 1;
 		info.bmiHeader.biBitCount = 32;
-		bitmap = CreateDIBSection(GetDC(hwnd), &info, DIB_RGB_COLORS, (void**)&bits, NULL, 0);
+		const auto dc = GetDC(hwnd);
+		bitmap = CreateDIBSection(dc, &info, DIB_RGB_COLORS, (void**)&bits, NULL, 0);
 		if (bitmap) {
-			hdc = CreateCompatibleDC(GetDC(hwnd));
+			hdc = CreateCompatibleDC(dc);
 			if (hdc)
 				SelectObject(hdc, bitmap);
 		}
+		ReleaseDC(hwnd, dc);
 	}
 
 public:
@@ -141,164 +168,108 @@ public:
 			memset(bits, color, width * height * sizeof(COLORREF));
 	}
 
-	void blit() {
-		if (hdc)
-			BitBlt(GetDC(hwnd), 0, 0, width, height, hdc, 0, 0, SRCCOPY);
-	}
-
-	Color* get_pixels() { return (Color*)bits; }
-	unsigned get_width() const { return width; }
-	unsigned get_height() const { return height; }
-
-	unsigned get_dpi() const { return GetDpiForWindow(hwnd); }
-};
-
-class Switcher {
-	std::vector<Buffer> buffers;
-	size_t active = 0;
-
-	std::string clipboard;
-
-	Buffer& current() { return buffers[active]; }
-	const Buffer& current() const { return buffers[active]; }
-
-	void select_index(unsigned index) { active = index >= 0 && index < buffers.size() ? index : active; }
-	void select_previous() { active = active > 0 ? active - 1 : buffers.size() - 1; }
-	void select_next() { active = (active + 1) % buffers.size(); }
-
-	size_t find_buffer(const std::string_view filename) {
-		for (size_t i = 0; i < buffers.size(); ++i) {
-			if (buffers[i].get_filename() == filename)
-				return i;
-		}
-		return (size_t)-1;
-	}
-
-	bool open_and_jump(const std::string_view url) {
-		const auto filename = extract_filename(url);
-		if (std::filesystem::exists(filename)) {
-			open(filename);
-			current().jump(extract_location(url));
-			return true;
-		}
-		return false;
+	void clear(uint32_t color, unsigned top, unsigned bottom) { // Rows [top, bottom) only.
+		bottom = std::min(bottom, height);
+		if (bits && top < bottom)
+			memset(bits + (size_t)top * width, color, (size_t)(bottom - top) * width * sizeof(COLORREF));
 	}
 
-	void open(const std::string_view filename) {
-		if (auto index = find_buffer(filename); index != (size_t)-1) {
-			active = index;
-		}
-		else if (buffers.size() < 10) { // No more than 10 tabs so we can use numbered fast switch.
-			buffers.emplace_back(filename);
-			active = buffers.size() - 1;
-			current().init(load(filename));
+	void blit() {
+		if (hdc) {
+			const auto dc = GetDC(hwnd);
+			BitBlt(dc, 0, 0, width, height, hdc, 0, 0, SRCCOPY);
+			ReleaseDC(hwnd, dc);
 		}
 	}
 
-	void reload() {
-		current().init(load(current().get_filename()));
-	}
-
-	void save() {
-		if (write(current().get_filename(), current().get_text())) {
-			current().set_dirty(false);
+	void blit(const std::vector<Rect>& rects) {
+		if (hdc) {
+			const auto dc = GetDC(hwnd);
+			for (auto& rect : rects) {
+				BitBlt(dc, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, hdc, rect.left, rect.top, SRCCOPY);
+			}
+			ReleaseDC(hwnd, dc);
 		}
 	}
 
-	void close() {
-		if (active > 0) { // Don't close buffer 0.
-			const auto filename = std::string(current().get_filename());
-			buffers.erase(buffers.begin() + active);
-			active = (active >= buffers.size() ? active - 1 : active) % buffers.size();
-		}
-	}
+	Color* get_pixels() { return (Color*)bits; }
+	unsigned get_width() const { return width; }
+	unsigned get_height() const { return height; }
 
-	void process_space_e() {
-		open("list");
-		current().init(list());
-		current().set_dirty(true);
-	}
+	unsigned get_dpi() const { return GetDpiForWindow(hwnd); }
+};
 
-	void process_space_f() {
-		const auto seed = current().get_word();
-		open(std::string("find ") + seed);
-		current().init(find(seed));
-		current().set_highlight(seed);
-	}
+std::string get_user_font_path() {
+	char path[MAX_PATH];
+	if (const auto res = SHGetSpecialFolderPathA(NULL, path, CSIDL_LOCAL_APPDATA, FALSE))
+		return std::string(path) + "\\Microsoft\\Windows\\Fonts\\";
+	return "";
+}
 
-	void process_space(bool& quit, bool& maximize, double& font_size, unsigned key) {
-		if (key == 'q') { quit = true; }
-		else if (key == 'm') { maximize = true; }
-		else if (key == '+') { font_size = std::min(font_size + 1.0, 80.0); }
-		else if (key == '-') { font_size = std::max(font_size - 1.0, 8.0); }
-		else if (key == 'w') { close(); }
-		else if (key == 'r') { reload(); }
-		else if (key == 's') { save(); }
-		else if (key == 'e') { process_space_e(); }
-		else if (key == 'f') { process_space_f(); }
-		else if (key == 'j') { current().window_down(); }
-		else if (key == 'k') { current().window_up(); }
-		else if (key == 'h') { select_previous(); }
-		else if (key == 'l') { select_next(); }
-		else if (key == 'n') { current().clear_highlight(); }
-		else if (key >= '0' && key <= '9') { select_index(key - '0'); }
+std::string get_system_font_path() {
+	char win_dir[MAX_PATH];
+	if (const auto len = GetWindowsDirectoryA(win_dir, MAX_PATH)) {
+		std::stringstream ss;
+		ss << win_dir << "\\Fonts\\";
+		return ss.str();
 	}
+	return "";
+}
 
-	void process_normal(unsigned key) {
-		bool jump = false;
-		current().process(clipboard, jump, key);
-		if (jump) {
-			if (!open_and_jump(current().get_url()))
-				open_and_jump(current().get_line_url());
+std::string get_system_font_name(const std::string& face_name) {
+	HKEY hkey;
+	static const char* registry = "Software\\Microsoft\\Windows NT\\CurrentVersion\\Fonts";
+	auto result = RegOpenKeyExA(HKEY_LOCAL_MACHINE, registry, 0, KEY_READ, &hkey);
+	if (result != ERROR_SUCCESS)
+		return "";
+
+	DWORD name_max_size, data_max_size;
+	result = RegQueryInfoKey(hkey, 0, 0, 0, 0, 0, 0, 0, &name_max_size, &data_max_size, 0, 0);
+	if (result != ERROR_SUCCESS)
+		return "";
+
+	DWORD index = 0;
+	std::vector<char> name(name_max_size);
+	std::vector<BYTE> data(data_max_size);
+	std::string font;
+
+	do {
+		DWORD data_size = data_max_size;
+		DWORD name_size = name_max_size;
+		DWORD type;
+		const auto result = RegEnumValueA(hkey, index++, name.data(), &name_size, 0, &type, data.data(), &data_size);
+		if (result != ERROR_SUCCESS || type != REG_SZ)
+			continue;
+
+		std::string font_name(name.data(), name_size);
+		if (_strnicmp(face_name.c_str(), font_name.c_str(), face_name.length()) == 0) {
+			font.assign((LPSTR)data.data(), data_size);
+			break;
 		}
-	}
+	} while (result != ERROR_NO_MORE_ITEMS);
 
-	void push_status(Characters& characters, unsigned col_count, const std::string_view text, const std::string_view status) const {
-		const unsigned row = 0;
-		unsigned col = 0;
-		push_line(characters, colors().status, row, col, col_count);
-		push_string(characters, colors().status_text, row, col, text);
-		push_string(characters, colors().status_text, row, col, "  ");
-		push_string(characters, colors().status_text, row, col, status);
-	}
+	RegCloseKey(hkey);
 
-	void push_tabs(Characters& characters) const {
-		const unsigned row = 1;
-		unsigned col = 0;
-		for (unsigned i = 0; i < buffers.size(); ++i) {
-			const auto back_color = i == active ? colors().bar_text : colors().bar;
-			const auto fore_color = i == active ? colors().bar : colors().bar_text;
-			const auto text = std::string(buffers[i].get_filename()) + (buffers[i].is_dirty() ? "*" : "");
-			push_line(characters, back_color, row, col, col + (int)(1 + text.size()));
-			characters.emplace_back(superscript_codepoint(i), fore_color, row, col++);
-			push_string(characters, fore_color, row, col, text);
-			col += 1;
-		}
-	}
-
-public:
-	Switcher() {
-		open("");
-	}
+	return font;
+}
 
-	void process(bool space_down, bool& quit, bool& maximize, double& font_size, unsigned key) {
-		if (space_down && current().is_normal()) { process_space(quit, maximize, font_size, key); }
-		else { process_normal(key); }
-	}
+std::string check_font(const std::string& font) {
+	if (std::filesystem::exists(font))
+		return font;
+	return {};
+}
 
-	Characters cull(unsigned col_count, unsigned row_count, const std::string_view text) {
-		Characters characters;
-		push_status(characters, col_count, text, current().status());
-		push_tabs(characters);
-		current().set_line_count(current().cull(characters, col_count, row_count));
-		return characters;
-	}
-};
+std::string find_font() {
+	if (const auto font = check_font(get_user_font_path() + "PragmataPro_Mono_R_liga.ttf"); !font.empty())
+		return font;
+	return check_font(get_system_font_path() + get_system_font_name("Consolas"));
+}
 
 class Application {
 	Switcher switcher;
 	Window window;
 	Book book;
+	Renderer renderer;
 
 	bool minimized = false;
 	bool maximized = false;
@@ -315,6 +286,7 @@ class Application {
 	void set_maximized(bool b) { maximized = b; }
 	void set_dirty(bool b) { dirty = b; }
 	void set_space_down(bool b) { space_down = b; }
+	void invalidate() { renderer.invalidate(); }
 
 	double get_default_font_size() const { return window.get_dpi() / 6.0; } 
 
@@ -329,58 +301,23 @@ class Application {
 			" " + std::to_string(process_time_ms) + "ms:" + std::to_string(render_time_ms) + "ms";
 	}
 
-	std::string check_font(const std::string& font) {
-		if (std::filesystem::exists(font))
-			return font;
-		return {};
-	}
-
-	std::string find_font() {
-		if (const auto font = check_font(get_user_font_path() + "PragmataPro_Mono_R_liga.ttf"); !font.empty())
-			return font;
-		return check_font(get_system_font_path() + get_system_font_name("Consolas"));
-	}
-
 	void resize(unsigned width, unsigned height) {
 		if (!minimized) {
 			window.resize(width, height);
+			renderer.reset();
 		}
 	}
 
-	void render_character(Color* pixels, const Character& character) {
-		const auto& glyph = book.find_glyph(character.index);
-		unsigned in = 0;
-		unsigned out = (book.get_line_baseline() + character.row * book.get_line_height() + glyph.mtx.yOffset) * window.get_width() +
-			(character.col * book.get_character_width() + (int)glyph.mtx.leftSideBearing);
-		auto color = character.color;
-		for (unsigned j = 0; j < (unsigned)glyph.mtx.minHeight; ++j) {
-			for (unsigned i = 0; i < (unsigned)glyph.mtx.minWidth; ++i) {
-				if (out + i < window.get_width() * window.get_height()) {
-					pixels[out + i].blend(color.set_alpha(glyph.pixels[in + i]));
-				}
-			}
-			in += glyph.mtx.minWidth;
-			out += window.get_width();
-		}
-	}
-
-	void render(const Characters& characters) {
-		if (auto* pixels = window.get_pixels()) {
-			window.clear(colors().clear.as_uint());
-			const auto col_count = get_col_count();
-			const auto row_count = get_row_count();
-			for (auto& character : characters) {
-				if (character.col < col_count && character.row < row_count)
-					render_character(pixels, character);
-			}
-			window.blit();
-		}
+	void render(const Characters& characters, int scroll) {
+		renderer.render(window, book, characters, get_col_count(), get_row_count(), scroll);
 	}
 
 	void redraw() {
 		if (!minimized && dirty) {
 			Timer timer;
-			render(switcher.cull(get_col_count(), get_row_count(), get_status_text()));
+			int scroll = 0;
+			const auto characters = switcher.cull(get_col_count(), get_row_count(), get_status_text(), scroll);
+			render(characters, scroll);
 			render_time_ms = timer.get_elapsed_time_ms();
 		}
 		else {
@@ -392,10 +329,14 @@ class Application {
 	void process(unsigned key) {
 		Timer timer;
 		bool maximize = false;
-		switcher.process(space_down, quit, maximize, font_size, key);
+		bool fields = false;
+		switcher.process(space_down, quit, maximize, fields, font_size, key);
 		if (maximize)
 			window.maximize(!maximized);
-		book.set_font_size(font_size); 
+		if (fields && book.set_fields(!book.get_fields()))
+			renderer.reset();
+		if (book.set_font_size(font_size))
+			renderer.reset();
 		process_time_ms = timer.get_elapsed_time_ms();
 	}
 
@@ -421,6 +362,7 @@ class Application {
 		case WM_ERASEBKGND: {
 			if (auto* app = reinterpret_cast<Application*>(GetWindowLongPtr(hwnd, GWLP_USERDATA))) {
 				app->set_dirty(true);
+				app->invalidate();
 			}
 			break;
 		}
@@ -0,0 +1,93 @@
+#pragma once
+
+class Workers { // Persistent threads sharing one parallel loop at a time with the calling thread.
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable done;
+	std::function<void(unsigned)> job;
+	unsigned job_count = 0;
+	std::atomic<unsigned> next_job = 0;
+	unsigned running = 0;
+	uint64_t generation = 0;
+	unsigned limit = UINT_MAX; // Threads that take jobs, so the bench can time scaling.
+	bool stop = false;
+
+	void run_jobs() {
+		for (unsigned index = next_job++; index < job_count; index = next_job++) {
+			job(index);
+		}
+	}
+
+	void work(unsigned thread) {
+		uint64_t seen = 0;
+		std::unique_lock lock(mutex);
+		while (true) {
+			start.wait(lock, [&] { return stop || generation != seen; });
+			if (stop)
+				return;
+			seen = generation;
+			const bool active = thread < limit;
+			lock.unlock();
+			if (active)
+				run_jobs();
+			lock.lock();
+			if (--running == 0)
+				done.notify_one();
+		}
+	}
+
+public:
+	Workers() {
+		const unsigned count = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+		for (unsigned i = 0; i < count; ++i) {
+			threads.emplace_back([this, i] { work(i); });
+		}
+	}
+
+	~Workers() {
+		{
+			std::lock_guard lock(mutex);
+			stop = true;
+		}
+		start.notify_all();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+	unsigned get_count() const { return (unsigned)threads.size(); }
+
+	void set_limit(unsigned count) {
+		std::lock_guard lock(mutex);
+		limit = count;
+	}
+
+	template <typename F>
+	void parallel_for(unsigned count, F func) { // Returns once func ran for all of [0, count).
+		if (count <= 1 || threads.empty() || limit == 0) {
+			for (unsigned index = 0; index < count; ++index) {
+				func(index);
+			}
+			return;
+		}
+		{
+			std::lock_guard lock(mutex);
+			job = func;
+			job_count = count;
+			next_job = 0;
+			running = (unsigned)threads.size();
+			generation++;
+		}
+		start.notify_all();
+		run_jobs();
+		std::unique_lock lock(mutex);
+		done.wait(lock, [&] { return running == 0; });
+	}
+};
+
+Workers& workers() {
+	static Workers workers;
+	return workers;
+}
+